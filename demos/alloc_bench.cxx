@@ -0,0 +1,165 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+// counts the heap allocations done while classifying a test file,
+// after a first warming up run over the same file. This is done for
+// lines, for comma separated fields, and for encoded value ids.
+//
+// usage: alloc_bench [train-file [test-file [options]]]
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <ctime>
+
+#include "timbl/TimblAPI.h"
+
+using namespace std;
+using namespace Timbl;
+
+// defined in alloc_count.cxx, together with the counting operator new
+extern unsigned long long allocations;
+
+static bool run( TimblAPI *exp, const vector<string>& lines,
+		 size_t& correct ){
+  string result;
+  double distance;
+  correct = 0;
+  for ( const auto& line : lines ){
+    if ( !exp->Classify( line, result, distance ) )
+      return false;
+    if ( line.size() >= result.size() &&
+	 line.compare( line.size()-result.size(), result.size(), result ) == 0 )
+      ++correct;
+  }
+  return true;
+}
+
+template <class T>
+static bool run_structured( TimblAPI *exp, const vector<vector<T>>& insts,
+			    const vector<string>& targets, size_t& correct ){
+  classifyResult res;
+  correct = 0;
+  for ( size_t i=0; i < insts.size(); ++i ){
+    if ( !exp->Classify( insts[i], res ) )
+      return false;
+    if ( res.target->Name() == targets[i] )
+      ++correct;
+  }
+  return true;
+}
+
+static void report( const string& what, size_t instances, size_t correct,
+		    unsigned long long used, clock_t t ){
+  cout << what << endl;
+  cout << "  instances   : " << instances << " (" << correct
+       << " correct)" << endl;
+  cout << "  allocations : " << used << " ("
+       << double(used)/instances << " per instance)" << endl;
+  cout << "  time        : " << double(t)/CLOCKS_PER_SEC << " seconds" << endl;
+}
+
+int main( int argc, char *argv[] ){
+  string train = "./dimin.train";
+  string test = "./dimin.test";
+  string opts = "-a IB1 +vS -k3";
+  if ( argc > 1 )
+    train = argv[1];
+  if ( argc > 2 )
+    test = argv[2];
+  if ( argc > 3 ){
+    opts = argv[3];
+    for ( int i=4; i < argc; ++i )
+      opts += string(" ") + argv[i];
+  }
+  vector<string> lines;
+  ifstream is( test );
+  string line;
+  while ( getline( is, line ) ){
+    if ( !line.empty() )
+      lines.push_back( line );
+  }
+  if ( lines.empty() ){
+    cerr << "no test lines in '" << test << "'" << endl;
+    return EXIT_FAILURE;
+  }
+  TimblAPI *exp = new TimblAPI( opts );
+  if ( !exp->Learn( train ) ){
+    cerr << "training on '" << train << "' failed" << endl;
+    return EXIT_FAILURE;
+  }
+  size_t correct;
+  if ( !run( exp, lines, correct ) ){
+    cerr << "classification failed" << endl;
+    return EXIT_FAILURE;
+  }
+  unsigned long long start = allocations;
+  clock_t t0 = clock();
+  run( exp, lines, correct );
+  clock_t t1 = clock();
+  cout << "options     : " << opts << endl;
+  report( "lines", lines.size(), correct, allocations - start, t1 - t0 );
+  vector<vector<string>> fields;
+  vector<vector<size_t>> ids;
+  vector<string> targets;
+  for ( const auto& line : lines ){
+    vector<string> parts;
+    string::size_type pos = 0;
+    string::size_type comma;
+    while ( ( comma = line.find( ',', pos ) ) != string::npos ){
+      parts.push_back( line.substr( pos, comma - pos ) );
+      pos = comma + 1;
+    }
+    targets.push_back( line.substr( pos ) );
+    vector<size_t> enc;
+    for ( size_t f=0; f < parts.size(); ++f ){
+      enc.push_back( exp->encodeFeatureValue( f, parts[f] ) );
+    }
+    fields.push_back( parts );
+    ids.push_back( enc );
+  }
+  if ( !run_structured( exp, fields, targets, correct ) ){
+    cerr << "classification of fields failed (comma separated data only)"
+	 << endl;
+    return EXIT_FAILURE;
+  }
+  start = allocations;
+  t0 = clock();
+  run_structured( exp, fields, targets, correct );
+  t1 = clock();
+  report( "fields", fields.size(), correct, allocations - start, t1 - t0 );
+  run_structured( exp, ids, targets, correct );
+  start = allocations;
+  t0 = clock();
+  run_structured( exp, ids, targets, correct );
+  t1 = clock();
+  report( "value ids", ids.size(), correct, allocations - start, t1 - t0 );
+  delete exp;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+// the global allocation functions that count for alloc_bench. They live
+// in a translation unit of their own, so the compiler never inlines a
+// free() into code where it can see the matching new-expression.
+// The array forms of new and delete default to these.
+
+#include <new>
+#include <cstdlib>
+
+using namespace std;
+
+unsigned long long allocations = 0;
+
+void *operator new( size_t size ){
+  ++allocations;
+  void *p = malloc( size ? size : 1 );
+  if ( !p )
+    throw bad_alloc();
+  return p;
+}
+
+void operator delete( void *p ) noexcept {
+  free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept {
+  free( p );
+}
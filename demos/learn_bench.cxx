@@ -0,0 +1,131 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+// times Learn() on generated data with a growing number of distinct
+// values per feature.
+//
+// usage: learn_bench [instances [features [options]]]
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <unistd.h>
+
+#include "timbl/TimblAPI.h"
+
+using namespace std;
+using namespace Timbl;
+
+static bool generate( const string& name, size_t lines, size_t feats,
+		      size_t values ){
+  // the first two features have only a few values and decide the class,
+  // so they end up on top of the tree, with all the others below them
+  ofstream os( name );
+  if ( !os )
+    return false;
+  mt19937 gen( 4711 );
+  uniform_int_distribution<size_t> top( 0, 9 );
+  uniform_int_distribution<size_t> val( 0, values-1 );
+  for ( size_t l=0; l < lines; ++l ){
+    size_t c1 = top( gen );
+    size_t c2 = top( gen );
+    os << "s" << c1 << ",t" << c2 << ",";
+    for ( size_t f=2; f < feats; ++f ){
+      os << "v" << val( gen ) << ",";
+    }
+    os << ( ( c1 + c2 ) % 2 == 0 ? "A" : "B" ) << endl;
+  }
+  return (bool)os;
+}
+
+static double seconds( chrono::steady_clock::time_point start ){
+  return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+int main( int argc, char *argv[] ){
+  size_t lines = 200000;
+  size_t feats = 4;
+  string opts = "-a IB1 +vS";
+  if ( argc > 1 )
+    lines = atol( argv[1] );
+  if ( argc > 2 )
+    feats = atol( argv[2] );
+  if ( argc > 3 ){
+    opts = argv[3];
+    for ( int i=4; i < argc; ++i )
+      opts += string(" ") + argv[i];
+  }
+  if ( lines == 0 || feats < 3 ){
+    cerr << "usage: learn_bench [instances [features(>2) [options]]]" << endl;
+    return EXIT_FAILURE;
+  }
+  string name = "/tmp/learn_bench." + to_string( getpid() );
+  string seed = name + ".seed";
+  name += ".data";
+  cout << "options     : " << opts << endl;
+  cout << "instances   : " << lines << ", " << feats << " features" << endl;
+  // Learn() on the whole file, and Expand() of a model of its first
+  // lines with all of it
+  cout << "   values       learn      expand" << endl;
+  bool ok = true;
+  for ( size_t values = 10; ok && values <= lines; values *= 10 ){
+    if ( !generate( name, lines, feats, values ) ||
+	 !generate( seed, 100, feats, values ) ){
+      cerr << "unable to write the data in /tmp" << endl;
+      ok = false;
+      break;
+    }
+    TimblAPI *exp = new TimblAPI( opts );
+    auto start = chrono::steady_clock::now();
+    ok = exp->Learn( name );
+    double learn = seconds( start );
+    delete exp;
+    double expand = 0;
+    if ( ok ){
+      exp = new TimblAPI( opts );
+      ok = exp->Learn( seed );
+      start = chrono::steady_clock::now();
+      ok = ok && exp->Expand( name );
+      expand = seconds( start );
+      delete exp;
+    }
+    if ( !ok ){
+      cerr << "training on '" << name << "' failed" << endl;
+      break;
+    }
+    cout << setw(9) << values << fixed << setprecision(3)
+	 << setw(12) << learn << setw(12) << expand << endl;
+  }
+  remove( name.c_str() );
+  remove( seed.c_str() );
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,159 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+
+// classifies a test file in several threads, while another thread adds
+// the first lines of that file to the model. Afterwards every answer is
+// checked against a single experiment that was incremented up to the
+// version the answer was given for.
+//
+// usage: online_learn [train-file [test-file [options]]]
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+
+#include "timbl/TimblAPI.h"
+
+using namespace std;
+using namespace Timbl;
+
+struct answer {
+  size_t version;
+  size_t line;
+  string result;
+  double distance;
+};
+
+static bool by_version( const answer& a, const answer& b ){
+  return a.version < b.version;
+}
+
+const size_t num_readers = 3;
+const size_t batch = 10;
+const size_t max_answers = 5000;
+
+int main( int argc, char *argv[] ){
+  string train = "./dimin.train";
+  string test = "./dimin.test";
+  string opts = "-a IB1 +vS";
+  if ( argc > 1 )
+    train = argv[1];
+  if ( argc > 2 )
+    test = argv[2];
+  if ( argc > 3 ){
+    opts = argv[3];
+    for ( int i=4; i < argc; ++i )
+      opts += string(" ") + argv[i];
+  }
+  vector<string> lines;
+  ifstream is( test );
+  string line;
+  while ( getline( is, line ) ){
+    if ( !line.empty() )
+      lines.push_back( line );
+  }
+  if ( lines.empty() ){
+    cerr << "no test lines in '" << test << "'" << endl;
+    return EXIT_FAILURE;
+  }
+  size_t to_add = min( lines.size(), (size_t)200 );
+  TimblOnline model( opts );
+  if ( !model.Learn( train ) ){
+    cerr << "training on '" << train << "' failed" << endl;
+    return EXIT_FAILURE;
+  }
+  model.BatchSize( batch );
+  atomic<bool> done( false );
+  vector<vector<answer>> answers( num_readers );
+  vector<thread> readers;
+  for ( size_t r=0; r < num_readers; ++r ){
+    readers.push_back( thread( [&,r](){
+	  TimblReader reader( model );
+	  size_t i = r;
+	  while ( answers[r].size() < max_answers ){
+	    answer a;
+	    a.line = i % lines.size();
+	    if ( !reader.Classify( lines[a.line], a.result, a.distance ) ){
+	      cerr << "classification failed" << endl;
+	      break;
+	    }
+	    a.version = reader.Version();
+	    answers[r].push_back( a );
+	    if ( done && a.version == model.Version() )
+	      break;
+	    i += num_readers;
+	  }
+	} ) );
+  }
+  for ( size_t i=0; i < to_add; ++i ){
+    model.Increment( lines[i] );
+  }
+  model.Publish();
+  done = true;
+  for ( auto& t : readers ){
+    t.join();
+  }
+  vector<answer> all;
+  for ( const auto& v : answers ){
+    all.insert( all.end(), v.begin(), v.end() );
+  }
+  stable_sort( all.begin(), all.end(), by_version );
+  TimblAPI ref( opts );
+  ref.Learn( train );
+  size_t added = 0;
+  size_t wrong = 0;
+  vector<size_t> per_version( model.Version()+1, 0 );
+  for ( const auto& a : all ){
+    while ( added < min( a.version*batch, to_add ) ){
+      ref.Increment( lines[added++] );
+    }
+    string result;
+    double distance;
+    ref.Classify( lines[a.line], result, distance );
+    if ( result != a.result || distance != a.distance ){
+      ++wrong;
+    }
+    ++per_version[a.version];
+  }
+  cout << "options     : " << opts << endl;
+  cout << "versions    : " << model.Version() << " (" << to_add
+       << " instances added in batches of " << batch << ")" << endl;
+  cout << "answers     : " << all.size() << " from " << num_readers
+       << " readers, per version:";
+  for ( const auto& n : per_version ){
+    cout << " " << n;
+  }
+  cout << endl;
+  cout << "mismatches  : " << wrong << endl;
+  return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,8 +32,12 @@ namespace Timbl{
 
   static const std::string DefaultSparseString = "0.0000E-17";
 
+  class DataCache;
+
   class Chopper {
+    friend class DataCache;
   public:
+    Chopper(): vSize(0), sparse_size(0) {};
     virtual ~Chopper() {};
     virtual bool chop( const std::string&, size_t ) = 0;
     const std::string& getField( size_t i ) const { return choppedInput[i]; };
@@ -48,7 +52,9 @@ namespace Timbl{
       for ( size_t i = target_pos+1; i < vSize; ++i )
 	choppedInput[i-1] = choppedInput[i];
       choppedInput[vSize-1] = tmp;
+      sparse_size = 0;
     }
+    const std::vector<size_t>& nonZero() const { return nonzero; };
     static Chopper *create( InputFormatType , bool, int, bool );
     static InputFormatType getInputFormat( const std::string&,
 					   bool=false );
@@ -58,9 +64,16 @@ namespace Timbl{
 				 bool=false );
   protected:
     virtual void init( const std::string&, size_t, bool );
+    virtual void setExW( double ){};
+    virtual void setOcc( int ){};
+    void reset_sparse( const std::string& );
     size_t vSize;
     std::string strippedInput;
     std::vector<std::string> choppedInput;
+    std::vector<std::string> splits;
+    // for the Sparse and Binary formats: the features set on this line
+    std::vector<size_t> nonzero;
+    size_t sparse_size;
   };
 
   class ExChopper: public virtual Chopper {
@@ -68,6 +81,7 @@ namespace Timbl{
     double getExW() const { return exW; };
   protected:
     void init( const std::string&, size_t, bool );
+    void setExW( double w ){ exW = w; };
     double exW;
   };
 
@@ -76,6 +90,7 @@ namespace Timbl{
     int getOcc() const { return occ; };
   protected:
     void init( const std::string&, size_t, bool );
+    void setOcc( int o ){ occ = o; };
     int occ;
   };
 
@@ -0,0 +1,91 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+
+*/
+#ifndef TIMBL_DATACACHE_H
+#define TIMBL_DATACACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "timbl/Types.h"
+
+namespace Timbl {
+
+  class Chopper;
+
+  // The pre-chopped contents of a data file: a dictionary of all the
+  // strings in the file, and per data line the dictionary codes of its
+  // fields, its exemplar weight and occurrence count, and the number of
+  // empty or comment lines in front of it.
+  // Once built it is stored in a cache directory, and reused as long as
+  // the size and modification time of the data file and the settings
+  // used to chop it are unchanged.
+  class DataCache {
+  public:
+    DataCache( const std::string&, InputFormatType, size_t, int, bool, bool );
+    bool matches( InputFormatType, size_t, int, bool, bool ) const;
+    bool load( const std::string& );
+    bool build( std::string&, bool = false );
+    bool save( const std::string& ) const;
+    bool usable() const { return ready; };
+    bool lenient() const { return skip_bad; };
+    size_t size() const { return exws.size(); };
+    size_t headSkips() const { return head_skips; };
+    void rewind(){ cursor = 0; };
+    size_t position() const { return cursor; };
+    void seek( size_t pos ){ cursor = pos; };
+    bool next( size_t&, size_t& );
+    void restore( size_t, Chopper * ) const;
+  private:
+    DataCache( const DataCache& );
+    DataCache& operator=( const DataCache& );
+    std::string cacheName( const std::string& ) const;
+    bool stamp();
+    bool consistent() const;
+    std::string data_file;
+    InputFormatType format;
+    size_t num_feats;
+    int f_length;
+    bool do_exw;
+    bool do_occ;
+    uint64_t file_size;
+    int64_t file_time;
+    bool ready;
+    bool skip_bad;
+    size_t cursor;
+    uint64_t head_skips;
+    uint64_t tail_gap;
+    std::vector<std::string> dict;
+    std::vector<unsigned int> codes;
+    std::vector<uint64_t> starts;
+    std::vector<unsigned int> gaps;
+    std::vector<double> exws;
+    std::vector<int> occs;
+  };
+
+}
+#endif // TIMBL_DATACACHE_H
@@ -0,0 +1,62 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+#ifndef TIMBL_DATASTREAM_H
+#define TIMBL_DATASTREAM_H
+
+#include <string>
+#include <istream>
+#include <fstream>
+
+namespace Timbl {
+
+  class inflate_buf;
+
+  // An input stream for data files. Files compressed with gzip or zstd,
+  // as recognized from their first bytes, are decompressed on a thread
+  // of their own while the lines are read. Such a stream can only be
+  // read from start to end: seekg() and tellg() fail on it.
+  class DataStream: public std::istream {
+  public:
+    DataStream();
+    explicit DataStream( const std::string&,
+			 std::ios::openmode = std::ios::in );
+    ~DataStream();
+    void open( const std::string&, std::ios::openmode = std::ios::in );
+    bool is_open() const;
+    void close();
+    bool compressed() const { return zbuf != 0; };
+  private:
+    DataStream( const DataStream& );
+    DataStream& operator=( const DataStream& );
+    std::filebuf fbuf;
+    inflate_buf *zbuf;
+  };
+
+  bool compressed_file( const std::string& );
+
+}
+#endif // TIMBL_DATASTREAM_H
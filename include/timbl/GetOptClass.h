@@ -39,9 +39,11 @@ namespace Timbl {
     explicit GetOptClass( const TiCC::CL_Options&  );
     virtual ~GetOptClass();
     GetOptClass *Clone( std::ostream * = 0 ) const;
+    GetOptClass *gridClone( bool ) const;
     bool parse_options( const TiCC::CL_Options&, const int=0 );
     void set_default_options( const int=0 );
     bool definitive_options( TimblExperiment * );
+    void reInit() { opt_init = false; };
     AlgorithmType Algo() const { return local_algo; };
     int MaxFeatures() const { return MaxFeats; };
     VerbosityFlags getVerbosity() { return myVerbosity; };
@@ -64,6 +66,9 @@ namespace Timbl {
     int maxbests;
     int clip_freq;
     int clones;
+    int bound_levels;
+    int linear_scan;
+    int cache_size;
     int BinSize;
     int BeamSize;
     int bootstrap_lines;
@@ -88,11 +93,20 @@ namespace Timbl {
     bool do_sloppy_loo;
     bool do_silly;
     bool do_diversify;
+    bool do_exact_index;
+    bool do_best_first;
+    bool do_compile;
     std::vector<MetricType>metricsArray;
     std::ostream *parent_socket_os;
     std::string inPath;
     std::string outPath;
+    std::string dataCacheDir;
     int occIn;
+    std::vector<int> sweep_neigh;
+    std::vector<DecayType> sweep_decay;
+    std::vector<double> sweep_alfa;
+    std::vector<double> sweep_beta;
+    bool do_sweep_out;
     void Error( const std::string& ) const;
     inline bool parse_range( std::string&,
 			     std::string::iterator&,
@@ -28,6 +28,10 @@
 #ifndef TIMBL_IBTREE_H
 #define TIMBL_IBTREE_H
 
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 #include "ticcutils/XMLtools.h"
 #include "timbl/MsgClass.h"
 
@@ -51,15 +55,31 @@ namespace Timbl {
   class ValueDistribution;
   class WValueDistribution;
 
+  class IBtree_pool;
+  class IBtree;
+  class IBtree_reader;
+  class InstanceBase_base;
+
+  // sorted arrays of the nodes in long sibling lists, keyed on the
+  // address of the pointer to the first sibling
+  typedef std::unordered_map<IBtree **, std::vector<IBtree *>> SI_map;
+
   class IBtree {
     friend class InstanceBase_base;
+    friend class IBtree_pool;
+    friend class IBtree_reader;
+    friend class IG_compiled;
+    friend class IB_sparse;
+    friend class IB_columns;
+    friend class IB_weights;
+    friend class IB_bounds;
     friend class IB_InstanceBase;
     friend class IG_InstanceBase;
     friend class TRIBL_InstanceBase;
     friend class TRIBL2_InstanceBase;
     friend std::ostream &operator<<( std::ostream&, const IBtree& );
     friend std::ostream &operator<<( std::ostream&, const IBtree * );
-    friend xmlNode *to_xml( IBtree *pnt );
+    friend void write_xml( std::ostream&, const IBtree *, size_t );
     friend int count_next( const IBtree * );
   public:
     const TargetValue* targetValue() const { return TValue; };
@@ -73,14 +93,23 @@ namespace Timbl {
     IBtree();
     explicit IBtree( FeatureValue * );
     ~IBtree();
-    IBtree *Reduce( const TargetValue *, unsigned long&, long );
+    IBtree *Reduce( const TargetValue *, unsigned long&, long, IBtree_pool& );
+    IBtree *reduce_upper( const TargetValue *, unsigned long&, long,
+			  IBtree_pool&, size_t );
 #ifdef IBSTATS
-    inline IBtree *add_feat_val( FeatureValue *, unsigned int&, IBtree **, unsigned long& );
+    static inline IBtree *add_feat_val( FeatureValue *, unsigned int&,
+					IBtree **, unsigned long&,
+					IBtree_pool&, SI_map& );
 #else
-    inline IBtree *add_feat_val( FeatureValue *, IBtree **, unsigned long& );
+    static inline IBtree *add_feat_val( FeatureValue *, IBtree **,
+					unsigned long&, IBtree_pool&,
+					SI_map& );
 #endif
+    static IBtree *add_indexed( FeatureValue *, IBtree **, unsigned long&,
+				IBtree_pool&, std::vector<IBtree *>& );
     inline ValueDistribution *sum_distributions( bool );
-    inline IBtree *make_unique( const TargetValue *, unsigned long& );
+    inline IBtree *make_unique( const TargetValue *, unsigned long&,
+				IBtree_pool& );
     void cleanDistributions();
     void re_assign_defaults( bool, bool );
     void assign_defaults( bool, bool, size_t );
@@ -95,8 +124,176 @@ namespace Timbl {
     IBtree& operator=( const IBtree& );
   };
 
+  // the nodes of an InstanceBase are allocated in blocks of growing size.
+  // Released nodes are kept for reuse, and all blocks are freed at once,
+  // without walking the tree.
+  class IBtree_pool {
+  public:
+    IBtree_pool(): free_nodes( 0 ), last_free( 0 ) {};
+    ~IBtree_pool();
+    IBtree *alloc( FeatureValue * = 0 );
+    void release( IBtree * );
+    void adopt( IBtree_pool& );
+  private:
+    IBtree_pool( const IBtree_pool& );
+    IBtree_pool& operator=( const IBtree_pool& );
+    struct block {
+      IBtree *nodes;
+      size_t size;
+      size_t used;
+    };
+    std::vector<block> blocks;
+    IBtree *free_nodes;
+    IBtree *last_free;
+  };
+
   typedef std::map<size_t, const IBtree*> FI_map;
 
+  struct FV_vec_hash {
+    size_t operator()( const std::vector<FeatureValue*>& ) const;
+  };
+
+  // maps the full (permuted) feature vector of an instance to its leaf
+  typedef std::unordered_map<std::vector<FeatureValue*>,
+			     IBtree*,
+			     FV_vec_hash> EM_map;
+
+  // a static, flattened copy of a (pruned) IGTree. Every level has an
+  // open addressing table keyed on (parent node, value index)
+  class IG_compiled {
+  public:
+    struct node {
+      const TargetValue *target;
+      const ValueDistribution *dist;
+      bool more;
+    };
+    IG_compiled( const IBtree *, size_t, bool );
+    inline const node *find( size_t, size_t&, const FeatureValue * ) const;
+    size_t nodeCount() const;
+    size_t byteSize() const;
+  private:
+    struct cell {
+      size_t parent;
+      size_t value;
+      size_t child;
+    };
+    static inline size_t hash( size_t p, size_t v ){
+      size_t h = v * 0x9e3779b97f4a7c15ULL ^ ( p + 0x632be59bd9b4e019ULL );
+      return h ^ ( h >> 29 );
+    };
+    std::vector<std::vector<cell>> tables;
+    std::vector<std::vector<node>> nodes;
+  };
+
+  // an inverted index on the non-zero values of a numeric instance base,
+  // used by the DotProduct and Cosine metrics on Sparse and Binary data
+  class IB_sparse {
+  public:
+    struct posting {
+      size_t leaf;
+      double value;
+    };
+    IB_sparse( const IBtree *, size_t,
+	       const std::vector<Feature *>&, const std::string& );
+    bool isZero( size_t level, const FeatureValue *fv ) const {
+      return fv == zeros[level];
+    };
+    bool numValue( const FeatureValue *, double& ) const;
+    size_t leafCount() const { return dists.size(); };
+    std::vector<std::vector<posting>> postings;
+    std::vector<const ValueDistribution *> dists;
+    std::vector<double> norms;
+    std::vector<double> weights;
+  private:
+    std::vector<FeatureValue *> zeros;
+    std::string dflt;
+  };
+
+  // all instances of an IB1 tree in columns: per level the ids of their
+  // values, which are positions in the values of that level. Used to
+  // scan the instances linearly when the tree hardly shares any paths
+  class IB_columns {
+  public:
+    IB_columns( const IBtree *, size_t );
+    size_t leafCount() const { return dists.size(); };
+    const std::vector<FeatureValue *>& levelValues( size_t l ) const {
+      return values[l];
+    };
+    const uint32_t *column( size_t l ) const { return &ids[l][0]; };
+    const ValueDistribution *distribution( size_t leaf ) const {
+      return dists[leaf];
+    };
+  private:
+    std::vector<std::vector<FeatureValue *>> values;
+    std::vector<std::vector<uint32_t>> ids;
+    std::vector<const ValueDistribution *> dists;
+  };
+
+  // the largest exemplar weight below every node of an IB1 tree. When
+  // all weights are positive, the weighted distance of an instance below
+  // a node is at least the distance so far divided by it
+  class IB_weights {
+  public:
+    explicit IB_weights( const IBtree * );
+    bool positive() const { return least > 0.0; };
+    double smallest() const { return least; };
+    double most( const IBtree *node ) const;
+  private:
+    double gather( const IBtree * );
+    std::unordered_map<const IBtree *, double> nodes;
+    double least;
+  };
+
+  // for the nodes on the upper levels of an IB1 tree: per deeper level
+  // a bitset of the values that occur below the node. The bits are the
+  // positions of the values in the (sorted) values of that level
+  class IB_bounds {
+  public:
+    IB_bounds( const IBtree *, size_t, size_t );
+    size_t levels() const { return n_levels; };
+    const std::vector<FeatureValue *>& levelValues( size_t l ) const {
+      return all_values[l];
+    };
+    size_t valueId( size_t, const FeatureValue * ) const;
+    const uint64_t *below( const IBtree * ) const;
+    bool occurs( const uint64_t *bits, size_t node_level,
+		 size_t level, size_t id ) const {
+      bits += offsets[level] - offsets[node_level+1];
+      return bits[id/64] & ( uint64_t(1) << (id%64) );
+    };
+  private:
+    void gather( const IBtree *, size_t, std::vector<uint64_t>& );
+    size_t n_levels;
+    size_t depth;
+    std::vector<std::vector<FeatureValue *>> all_values;
+    std::vector<size_t> offsets;
+    std::vector<uint64_t> bits;
+    std::unordered_map<const IBtree *, size_t> nodes;
+  };
+
+  // the least distances between a test instance and all instances below
+  // the nodes on the upper levels of the current search path. They are
+  // computed when first asked for
+  class IB_path_bounds {
+  public:
+    IB_path_bounds(): ib(0) {};
+    void init( const InstanceBase_base *,
+	       const std::vector<FeatureValue *>&,
+	       const std::vector<double>& );
+    void invalidate( size_t from ){
+      for ( size_t l=from; l < valid.size(); ++l )
+	valid[l] = false;
+    };
+    size_t size() const { return valid.size(); };
+    const std::vector<double>& least( size_t );
+  private:
+    const InstanceBase_base *ib;
+    std::vector<size_t> ids;
+    std::vector<double> nearest;
+    std::vector<std::vector<double>> paths;
+    std::vector<bool> valid;
+  };
+
   class InstanceBase_base: public MsgClass {
     friend class IG_InstanceBase;
     friend class TRIBL_InstanceBase;
@@ -117,14 +314,45 @@ namespace Timbl {
     void summarizeNodes( std::vector<unsigned int>&,
 			 std::vector<unsigned int>& );
     virtual bool MergeSub( InstanceBase_base * );
-    const ValueDistribution *ExactMatch( const Instance& I ) const {
-      return InstBase->exact_match( I ); };
+    const ValueDistribution *ExactMatch( const Instance& ) const;
+    void BuildExactIndex();
+    bool HasExactIndex() const { return exact_index != 0; };
+    const IG_compiled *Compile();
+    void Uncompile();
+    const IG_compiled *Compiled() const { return compiled; };
+    const IB_sparse *IndexSparse( const std::vector<Feature *>&,
+				  const std::string& );
+    void DropSparseIndex();
+    const IB_sparse *SparseIndex() const { return sparse_index; };
+    const IB_columns *BuildColumns();
+    void DropColumns();
+    const IB_columns *Columns() const { return columns; };
+    size_t SpreadLevel();
+    const IB_weights *BuildWeights();
+    void DropWeights();
+    const IB_weights *Weights() const { return weights; };
+    double PathWeight( size_t ) const;
+    const IB_bounds *BuildBounds( size_t );
+    void DropBounds();
+    const IB_bounds *Bounds() const { return bounds; };
+    void SubtreeBound( size_t,
+		       const std::vector<size_t>&,
+		       const std::vector<double>&,
+		       std::vector<double>& ) const;
     virtual const ValueDistribution *InitGraphTest( std::vector<FeatureValue *>&,
 						    const std::vector<FeatureValue *> *,
 						    size_t,
 						    size_t );
     virtual const ValueDistribution *NextGraphTest( std::vector<FeatureValue *>&,
 					      size_t& );
+    void BestFirst( const std::vector<Feature *> *feats, int limit ){
+      order_feats = feats;
+      order_limit = limit;
+    };
+    virtual bool sortedLevel( size_t ) const { return false; };
+    unsigned long int NodeVisits() const { return node_visits; };
+    void addVisits( unsigned long int v ) { node_visits += v; };
+    void resetVisits() { node_visits = 0; };
     unsigned long int GetDistSize( ) const { return NumOfTails; };
     virtual const ValueDistribution *IG_test( const Instance& , size_t&, bool&,
 					      const TargetValue *& );
@@ -149,6 +377,9 @@ namespace Timbl {
     virtual void Prune( const TargetValue *, long = 0 );
     virtual bool IsPruned() const { return false; };
     void CleanPartition(  bool );
+    void sharePool( InstanceBase_base * );
+    void ReadThreads( int n ){ read_threads = n; };
+    void PruneThreads( int n ){ prune_threads = n; };
     unsigned long int GetSizeInfo( unsigned long int&, double & ) const;
     const ValueDistribution *TopDist() const { return TopDistribution; };
     bool HasDistributions() const;
@@ -174,13 +405,30 @@ namespace Timbl {
     bool tiedTop;
     IBtree *InstBase;
     IBtree *LastInstBasePos;
+    IBtree_pool own_nodes;
+    IBtree_pool *pool;
+    SI_map sibling_index;
     const IBtree **RestartSearch;
     const IBtree **SkipSearch;
     const IBtree **InstPath;
+    EM_map *exact_index;
+    mutable std::vector<FeatureValue*> em_key;
+    IG_compiled *compiled;
+    IB_sparse *sparse_index;
+    IB_columns *columns;
+    size_t spread_level;
+    IB_weights *weights;
+    IB_bounds *bounds;
+    const std::vector<Feature *> *order_feats;
+    int order_limit;
+    int read_threads;
+    int prune_threads;
+    unsigned long int node_visits;
     unsigned long int& ibCount;
 
     size_t Depth;
     unsigned long int NumOfTails;
+    size_t split_level( bool, std::vector<IBtree *>& ) const;
     IBtree *read_list( std::istream &,
 		       std::vector<Feature*>&, Target *,
 		       int );
@@ -193,6 +441,8 @@ namespace Timbl {
     IBtree *read_local_hashed( std::istream &,
 			       std::vector<Feature*>&, Target *,
 			       int );
+    IBtree *read_top( std::istream &, std::vector<Feature*>&, Target *,
+		      bool );
     void write_tree( std::ostream &os, const IBtree * ) const;
     void write_tree_hashed( std::ostream &os, const IBtree * ) const;
     bool read_IB( std::istream &, std::vector<Feature *>&, Target *, int );
@@ -200,6 +450,8 @@ namespace Timbl {
 		  Hash::StringHash *, Hash::StringHash *, int );
     void fill_index();
     const IBtree *fast_search_node( FeatureValue * );
+    void fill_exact_index( IBtree *, size_t );
+    IBtree *exact_leaf( const Instance& ) const;
   };
 
   class IB_InstanceBase: public InstanceBase_base {
@@ -218,12 +470,19 @@ namespace Timbl {
 					    size_t );
     const ValueDistribution *NextGraphTest( std::vector<FeatureValue *>&,
 				      size_t& );
+    bool sortedLevel( size_t l ) const { return l < sorted.size() && sorted[l]; };
   private:
     IB_InstanceBase( const IB_InstanceBase& ); // inhibit copy
     IB_InstanceBase& operator=( const IB_InstanceBase& ); // inhibit copy
+    const IBtree *sort_siblings( size_t, const IBtree * );
     size_t offSet;
     size_t effFeat;
     const std::vector<FeatureValue *> *testInst;
+    // for best-first search: per level the siblings on the current path,
+    // ordered on their distance to the test value
+    std::vector<bool> sorted;
+    std::vector<std::vector<std::pair<double,const IBtree *>>> siblings;
+    std::vector<size_t> sib_pos;
   };
 
   class IG_InstanceBase: public InstanceBase_base {
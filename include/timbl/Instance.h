@@ -48,6 +48,37 @@ namespace Timbl {
 
   class TargetValue;
 
+  namespace Recycle {
+    // distributions are built and thrown away again for every instance we
+    // classify. Their small parts are recycled via per thread free lists
+    void *get( size_t );
+    void put( void *, size_t );
+
+    template <class T>
+      class allocator {
+    public:
+      typedef T value_type;
+      allocator() noexcept {};
+      template <class U> allocator( const allocator<U>& ) noexcept {};
+      T *allocate( size_t n ){
+	return static_cast<T*>( get( n * sizeof(T) ) );
+      }
+      void deallocate( T *p, size_t n ){
+	put( p, n * sizeof(T) );
+      }
+    };
+
+    template <class T, class U>
+      bool operator==( const allocator<T>&, const allocator<U>& ){
+      return true;
+    }
+
+    template <class T, class U>
+      bool operator!=( const allocator<T>&, const allocator<U>& ){
+      return false;
+    }
+  }
+
   class Vfield{
     friend class ValueDistribution;
     friend class WValueDistribution;
@@ -59,6 +90,8 @@ namespace Timbl {
   Vfield( const Vfield& in ):
     value(in.value), frequency(in.frequency), weight(in.weight) {};
     ~Vfield(){};
+    static void *operator new( size_t s ){ return Recycle::get( s ); };
+    static void operator delete( void *p, size_t s ){ Recycle::put( p, s ); };
     std::ostream& put( std::ostream& ) const;
     const TargetValue *Value() const { return value; };
     void Value( const TargetValue *t ){  value = t; };
@@ -86,11 +119,14 @@ namespace Timbl {
     friend std::ostream& operator<<( std::ostream&, const ValueDistribution * );
     friend class WValueDistribution;
   public:
-    typedef std::map<size_t, Vfield *> VDlist;
+    typedef std::map<size_t, Vfield *, std::less<size_t>,
+      Recycle::allocator<std::pair<const size_t, Vfield *>>> VDlist;
     typedef VDlist::const_iterator dist_iterator;
     ValueDistribution( ): total_items(0) {};
     ValueDistribution( const ValueDistribution& );
     virtual ~ValueDistribution(){ clear(); };
+    static void *operator new( size_t s ){ return Recycle::get( s ); };
+    static void operator delete( void *p, size_t s ){ Recycle::put( p, s ); };
     size_t totalSize() const{ return total_items; };
     size_t size() const{ return distribution.size(); };
     bool empty() const{ return distribution.empty(); };
@@ -251,6 +287,7 @@ namespace Timbl {
     void Ignore( const bool val ){ ignore = val; };
     bool setMetricType( const MetricType );
     MetricType getMetricType() const;
+    void unshare();
     double Weight() const { return weight; };
     void SetWeight( const double w ) { weight = w; };
     double InfoGain() const { return info_gain; };
@@ -270,6 +307,7 @@ namespace Timbl {
     double Max() const { return n_max; };
     void Max( const double val ){ n_max = val; };
     double fvDistance( FeatureValue *, FeatureValue *, size_t=1 ) const;
+    double fvDistance( FeatureValue *, FeatureValue *, size_t, double ) const;
     FeatureValue *add_value( const std::string&, TargetValue *, int=1 );
     FeatureValue *add_value( size_t, TargetValue *, int=1 );
     FeatureValue *Lookup( const std::string& ) const ;
@@ -279,6 +317,7 @@ namespace Timbl {
     bool isStorableMetric() const;
     bool AllocSparseArrays( size_t );
     void InitSparseArrays();
+    bool refresh_value( FeatureValue *, size_t, size_t, int = 1 );
     bool ArrayRead(){ return vcpb_read; };
     bool matrixPresent( bool& ) const;
     size_t matrix_byte_size() const;
@@ -296,13 +335,18 @@ namespace Timbl {
     SparseSymetricMatrix<ValueClass *> *metric_matrix;
  private:
     metricClass *metric;
+    bool own_metric;
+    bool unshared;
     bool ignore;
     bool numeric;
     bool vcpb_read;
+    bool matrix_current;
+    int matrix_limit;
     enum ps_stat{ ps_undef, ps_failed, ps_ok, ps_read };
     enum ps_stat PrestoreStatus;
     MetricType Prestored_metric;
     void delete_matrix();
+    void InitSparseArray( FeatureValue * );
     double entropy;
     double info_gain;
     double split_info;
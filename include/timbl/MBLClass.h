@@ -28,10 +28,12 @@
 #ifndef TIMBL_MBLCLASS_H
 #define TIMBL_MBLCLASS_H
 
+#include <unordered_map>
 #include "timbl/Instance.h"
 #include "timbl/BestArray.h"
 #include "timbl/neighborSet.h"
 #include "timbl/Options.h"
+#include "ticcutils/Timer.h"
 
 typedef struct _xmlNode xmlNode;
 
@@ -43,6 +45,11 @@ namespace Timbl {
   using namespace Common;
 
   class InstanceBase_base;
+  class IB_InstanceBase;
+  class IB_sparse;
+  class IB_columns;
+  class IB_bounds;
+  class IB_path_bounds;
   class TesterClass;
   class Chopper;
   class neighborSet;
@@ -81,6 +88,8 @@ namespace Timbl {
 
     bool writeArrays( std::ostream& );
     bool readArrays( std::istream& );
+    // after changes to the permutation or CurrInst
+    void forget_sparse(){ sparse_fresh = false; };
     bool writeMatrices( std::ostream& ) const;
     bool readMatrices( std::istream& );
     bool writeWeights( std::ostream& ) const;
@@ -93,13 +102,19 @@ namespace Timbl {
     virtual ~MBLClass();
     void InitClass( const size_t );
     void Initialize( size_t = 0 );
+    void set_feature_metrics();
+    MetricType userMetric( size_t j ) const { return UserOptions[j+1]; };
+    bool initSharedArrays();
     bool PutInstanceBase( std::ostream& ) const;
     VerbosityFlags get_verbosity() const { return verbosity; };
     void set_verbosity( VerbosityFlags v ) { verbosity = v; };
     const Instance *chopped_to_instance( PhaseValue );
+    const Instance *fields_to_instance( const std::vector<std::string>& );
+    const Instance *values_to_instance( const std::vector<size_t>& );
     bool Chop( const std::string& );
     bool HideInstance( const Instance& );
     bool UnHideInstance( const Instance&  );
+    void refresh_arrays( const Instance& );
     std::string formatInstance( const std::vector<FeatureValue *>&,
 				std::vector<FeatureValue *>&,
 				size_t,	size_t ) const;
@@ -190,12 +205,36 @@ namespace Timbl {
     bool tableFilled;
     MetricType globalMetricOption;
     bool do_diversify;
+    bool do_exact_index;
+    bool do_best_first;
+    bool do_compile;
+    size_t bound_levels;
+    int linear_scan;
     bool initProbabilityArrays( bool );
     void calculatePrestored();
+    virtual int Clones() const { return 1; };
+    TiCC::Timer stat_timer;
+    TiCC::Timer array_timer;
+    TiCC::Timer matrix_timer;
     void initDecay();
     void initTesters();
     Chopper *ChopInput;
     int F_length;
+    bool chopExamples() const {
+      return do_sample_weighting &&
+	!( runningPhase == TestWords && no_samples_test ); }
+    bool chopOcc() const {
+      switch( runningPhase ) {
+      case TrainWords:
+      case LearnWords:
+      case TrainLearnWords:
+	return doOcc == 1 || doOcc == 3;
+      case TestWords:
+	return doOcc > 1;
+      default:
+	return false;
+      }
+    };
   private:
     size_t MaxFeatures;
     std::vector<MetricType> UserOptions;
@@ -224,21 +263,6 @@ namespace Timbl {
     double DBEntropy;
     TesterClass *tester;
     int doOcc;
-    bool chopExamples() const {
-      return do_sample_weighting &&
-	!( runningPhase == TestWords && no_samples_test ); }
-    bool chopOcc() const {
-      switch( runningPhase ) {
-      case TrainWords:
-      case LearnWords:
-      case TrainLearnWords:
-	return doOcc == 1 || doOcc == 3;
-      case TestWords:
-	return doOcc > 1;
-      default:
-	return false;
-      }
-    };
     void fill_table();
     void InvalidMessage() const ;
     double calculate_db_entropy( Target * );
@@ -251,6 +275,47 @@ namespace Timbl {
 			    InstanceBase_base * = NULL,
 			    size_t = 0 );
 
+    void test_instance_sparse( const Instance&,
+			       const IB_sparse * );
+    void test_instance_scan( const Instance&,
+			     const IB_columns * );
+
+    FeatureValue *dummy_value( const std::string& );
+    void release_dummies();
+    std::vector<std::string *> dummy_names;
+    std::vector<FeatureValue *> dummy_values;
+    size_t dummies_used;
+    std::vector<FeatureValue *> query_fv;
+    mutable std::vector<size_t> inv_perm;
+    // for skipping subtrees with the IB_bounds of an InstanceBase: the
+    // least distance to another value, per level and test value, and the
+    // bounds for the current search path
+    void init_bounds( const Instance&, const InstanceBase_base * );
+    bool bounded( size_t, double );
+    const IB_bounds *nearest_for;
+    std::vector<std::unordered_map<const FeatureValue *, double>> nearest_cache;
+    std::vector<double> nearest;
+    IB_path_bounds *path_bounds;
+    // the largest exemplar weights below the current search path
+    std::vector<double> path_weights;
+
+    bool sparse_input() const;
+    void sparse_to_instance( bool );
+    bool sparse_reset();
+    // the previous sparse line is kept in CurrInst, with the defaults per
+    // level, the levels it set and those without a default value yet
+    bool sparse_fresh;
+    std::vector<FeatureValue *> sparse_defaults;
+    std::vector<size_t> sparse_level;
+    std::vector<size_t> sparse_set;
+    std::vector<size_t> sparse_missing;
+    std::vector<double> sparse_acc;
+    std::vector<size_t> sparse_touched;
+    std::vector<bool> sparse_mark;
+    std::vector<std::vector<double>> scan_table;
+    std::vector<double> scan_acc;
+
+    double path_weight( const InstanceBase_base *, size_t );
     void test_instance_ex( const Instance&,
 			   InstanceBase_base * = NULL,
 			   size_t = 0 );
@@ -29,6 +29,8 @@
 #ifndef TIMBL_MATRICES_H
 #define TIMBL_MATRICES_H
 
+#include <utility>
+
 template <class T>  class SparseSymetricMatrix;
 template <class T> std::ostream& operator << (std::ostream&,
 					      const SparseSymetricMatrix<T>& );
@@ -50,6 +52,18 @@ class SparseSymetricMatrix {
       else
 	my_mat[i][j] = d;
   };
+  void Remove( Class i, Class j ){
+    if ( i == j )
+      return;
+    if ( i < j )
+      std::swap( i, j );
+    typename CCDmap::iterator it1 = my_mat.find(i);
+    if ( it1 != my_mat.end() ){
+      it1->second.erase(j);
+      if ( it1->second.empty() )
+	my_mat.erase( it1 );
+    }
+  };
   double Extract( Class i, Class j ) const {
     if ( i == j ){
       return 0.0;
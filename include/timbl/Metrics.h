@@ -30,6 +30,10 @@
 #define TIMBL_METRICS_H
 
 #include <limits>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 
 namespace Timbl{
 
@@ -45,8 +49,17 @@ namespace Timbl{
     virtual bool isSimilarityMetric() const = 0;
     virtual bool isNumerical() const = 0;
     virtual bool isStorable() const = 0;
+    // false for metrics that fill caches while they work: every thread
+    // needs its own copy of those
+    virtual bool isShareable() const { return true; };
     virtual double distance( FeatureValue *, FeatureValue *,
 			     size_t=1, double = 1.0 ) const = 0;
+    // like distance(), but it may stop early, and return a lower value,
+    // once the distance is sure to exceed the bound.
+    virtual double bounded_distance( FeatureValue *F, FeatureValue *G,
+				     size_t limit, double ) const {
+      return distance( F, G, limit );
+    };
   private:
     MetricType _type;
   };
@@ -96,13 +109,6 @@ namespace Timbl{
     double distance( FeatureValue *, FeatureValue *, size_t, double ) const;
   };
 
-  class DiceMetric: public distanceMetricClass {
-  public:
-  DiceMetric(): distanceMetricClass( Dice ){};
-    bool isNumerical() const { return false; };
-    bool isStorable() const { return true; };
-    double distance( FeatureValue *, FeatureValue *, size_t, double ) const;
-  };
 
   class JeffreyMetric: public distanceMetricClass {
   public:
@@ -120,12 +126,51 @@ namespace Timbl{
     double distance( FeatureValue *, FeatureValue *, size_t, double ) const;
   };
 
-  class LevenshteinMetric: public distanceMetricClass {
+  class stringMetricClass: public distanceMetricClass {
+    // the metrics that compare the strings of two values. The distances
+    // between values seen in training are remembered in a bounded cache
   public:
-  LevenshteinMetric(): distanceMetricClass( Levenshtein ){};
+    explicit stringMetricClass( MetricType m ):
+      distanceMetricClass( m ){};
+    virtual ~stringMetricClass() {};
     bool isNumerical() const { return false; };
     bool isStorable() const { return true; };
+    bool isShareable() const { return false; };
     double distance( FeatureValue *, FeatureValue *, size_t, double ) const;
+    double bounded_distance( FeatureValue *, FeatureValue *,
+			     size_t, double ) const;
+  protected:
+    // returns false when the result is only a lower bound
+    virtual bool string_distance( FeatureValue *, FeatureValue *,
+				  double, double& ) const = 0;
+  private:
+    mutable std::unordered_map<uint64_t,double> pair_cache;
+  };
+
+  class LevenshteinMetric: public stringMetricClass {
+  public:
+  LevenshteinMetric(): stringMetricClass( Levenshtein ){};
+  private:
+    bool string_distance( FeatureValue *, FeatureValue *,
+			  double, double& ) const;
+    mutable std::vector<size_t> rows;
+  };
+
+  class DiceMetric: public stringMetricClass {
+  public:
+  DiceMetric(): stringMetricClass( Dice ){};
+  private:
+    // the sorted unigrams and bigrams of a value
+    struct signature {
+      std::vector<uint16_t> unigrams;
+      std::vector<uint16_t> bigrams;
+    };
+    bool string_distance( FeatureValue *, FeatureValue *,
+			  double, double& ) const;
+    const signature& get_signature( FeatureValue *, signature& ) const;
+    mutable std::unordered_map<size_t,signature> signatures;
+    mutable signature scratch1;
+    mutable signature scratch2;
   };
 
   class similarityMetricClass: public metricClass {
@@ -30,19 +30,23 @@
 #define TIMBL_TESTERS_H
 
 namespace Timbl{
+  class IB_path_bounds;
+
   class metricTestFunction {
   public:
     virtual ~metricTestFunction(){};
     virtual double test( FeatureValue *,
 			 FeatureValue *,
-			 Feature * ) const = 0;
+			 Feature *,
+			 double ) const = 0;
   };
 
   class overlapTestFunction: public metricTestFunction {
   public:
     double test( FeatureValue *FV,
 		 FeatureValue *G,
-		 Feature *Feat ) const;
+		 Feature *Feat,
+		 double ) const;
   };
 
   class valueDiffTestFunction: public metricTestFunction {
@@ -53,7 +57,8 @@ namespace Timbl{
       {};
     double test( FeatureValue *,
 		 FeatureValue *,
-		 Feature * ) const;
+		 Feature *,
+		 double ) const;
   protected:
     int threshold;
   };
@@ -68,7 +73,12 @@ namespace Timbl{
 			 size_t,
 			 double ) = 0;
     virtual double getDistance( size_t ) const = 0;
+    virtual double valueDistance( size_t, FeatureValue * ) const {
+      return 0.0;
+    };
+    void setBounds( IB_path_bounds *b ){ bounds = b; };
   protected:
+    IB_path_bounds *bounds;
     size_t _size;
     size_t effSize;
     size_t offSet;
@@ -89,6 +99,7 @@ namespace Timbl{
 		    int );
     ~DistanceTester();
     double getDistance( size_t ) const;
+    double valueDistance( size_t, FeatureValue * ) const;
     size_t test( std::vector<FeatureValue *>&,
 		 size_t,
 		 double );
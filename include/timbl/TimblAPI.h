@@ -31,6 +31,8 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include "ticcutils/CommandLine.h"
 #include "timbl/Common.h"
 #include "timbl/MsgClass.h"
@@ -48,8 +50,19 @@ namespace Timbl{
   enum Algorithm { UNKNOWN_ALG, IB1, IB2, IGTREE, TRIBL, TRIBL2, LOO, CV };
   enum Weighting { UNKNOWN_W, UD, NW, GR, IG, X2, SV, SD };
 
+  // the outcome of the Classify() overloads for fields and value ids.
+  // The distribution is the raw (not normalized) distribution of the
+  // nearest neighbors, valid until the next classification
+  struct classifyResult {
+    classifyResult(): target(0), distance(-1.0), distribution(0) {};
+    const TargetValue *target;
+    double distance;
+    const ValueDistribution *distribution;
+  };
+
   class TimblAPI {
     friend class TimblExperiment;
+    friend class TimblOnline;
   public:
     TimblAPI( const TiCC::CL_Options&, const std::string& = "" );
     TimblAPI( const std::string&,  const std::string& = "" );
@@ -79,6 +92,11 @@ namespace Timbl{
 	       const std::string& = "" );
     bool NS_Test( const std::string& = "",
 		  const std::string& = "" );
+    bool GridSearch( const std::string&,
+		     const std::string&,
+		     const std::vector<std::string>&,
+		     const std::vector<std::string>&,
+		     size_t = 0 );
     const TargetValue *Classify( const std::string& );
     const TargetValue *Classify( const std::string&,
 				 const ValueDistribution *& );
@@ -86,6 +104,9 @@ namespace Timbl{
     const TargetValue *Classify( const std::string&,
 				 const ValueDistribution *&,
 				 double& );
+    size_t encodeFeatureValue( size_t, const std::string& ) const;
+    bool Classify( const std::vector<std::string>&, classifyResult& );
+    bool Classify( const std::vector<size_t>&, classifyResult& );
     const neighborSet *classifyNS( const std::string& );
     bool classifyNS( const std::string&, neighborSet& );
     const Instance *lastHandledInstance() const;
@@ -132,6 +153,66 @@ namespace Timbl{
     bool i_am_fine;
   };
 
+  // Online learning while classifying: TimblOnline keeps two copies of
+  // an IB1 model. Increment and Decrement are queued, and Publish()
+  // applies them to the copy no reader uses, makes that the current
+  // version, and then brings the other copy up to date.
+  // Every classifying thread uses its own TimblReader, which classifies
+  // against the version that was current when the classification began.
+  // Readers never wait for the writer, the writer only waits for
+  // classifications that are already running on the copy it updates.
+  // Learn() has to be done before any reader is used.
+  class TimblOnline {
+    friend class TimblReader;
+  public:
+    TimblOnline( const std::string&, const std::string& = "" );
+    ~TimblOnline();
+    bool Valid() const;
+    bool Learn( const std::string& = "" );
+    bool Increment( const std::string& );
+    bool Decrement( const std::string& );
+    size_t Publish();
+    void BatchSize( size_t s ){ batch_size = s; };
+    size_t Version() const { return version; };
+    size_t Pending() const;
+  private:
+    TimblOnline( const TimblOnline& );
+    TimblOnline& operator=( const TimblOnline& );
+    bool enqueue( bool, const std::string& );
+    void waitForReaders( int ) const;
+    TimblExperiment *snapshot( int ) const;
+    bool apply( int, const std::vector<std::pair<bool,std::string>>& );
+    TimblAPI *sides[2];
+    std::atomic<int> active;
+    std::atomic<int> readers[2];
+    std::atomic<size_t> stamps[2];
+    std::atomic<size_t> version;
+    size_t batch_size;
+    std::vector<std::pair<bool,std::string>> pending;
+    mutable std::mutex queue_lock;
+    std::mutex publish_lock;
+  };
+
+  class TimblReader {
+  public:
+    explicit TimblReader( TimblOnline& );
+    ~TimblReader();
+    bool Classify( const std::string&, std::string& );
+    bool Classify( const std::string&, std::string&, double& );
+    bool Classify( const std::string&, std::string&,
+		   std::string&, double& );
+    size_t Version() const { return version; };
+  private:
+    TimblReader( const TimblReader& );
+    TimblReader& operator=( const TimblReader& );
+    TimblExperiment *enter( int& );
+    void leave( int );
+    TimblOnline& model;
+    TimblExperiment *children[2];
+    size_t stamps[2];
+    size_t version;
+  };
+
   const std::string to_string( const Algorithm );
   const std::string to_string( const Weighting );
   bool string_to( const std::string&, Algorithm& );
@@ -32,10 +32,13 @@
 #include <sys/time.h>
 #include <fstream>
 #include <set>
+#include <list>
+#include <unordered_map>
 #include "ticcutils/XMLtools.h"
 #include "timbl/Statistics.h"
 #include "timbl/MsgClass.h"
 #include "timbl/MBLClass.h"
+#include "timbl/DataStream.h"
 
 namespace TiCC {
   class CL_Options;
@@ -49,10 +52,15 @@ namespace Timbl {
   extern const std::string timbl_indirect_opts;
 
   class TimblAPI;
+  class TimblExperiment;
   class ConfusionMatrix;
   class GetOptClass;
   class TargetValue;
   class Instance;
+  class orderSample;
+
+  TimblExperiment *Create_Pimpl( AlgorithmType, const std::string&,
+				 GetOptClass * );
 
   class resultStore: public MsgClass {
   public:
@@ -78,6 +86,8 @@ namespace Timbl {
     double confidence( const TargetValue* tv ) const {
       return dist->Confidence( tv );
     };
+    const ValueDistribution *rawDistribution() const { return rawDist; };
+    bool topResult() const { return isTop; };
   private:
     resultStore( const resultStore& ); // inhibit copies
     resultStore& operator=( const resultStore& ); // inhibit copies
@@ -93,6 +103,46 @@ namespace Timbl {
     std::string resultCache;
   };
 
+  class cachedResult {
+  public:
+  cachedResult(): target(0), dist(0), top(0), distance(0.0),
+      exact(false), counted_exact(false), tie(false),
+      has_depth(false), match_depth(0), last_leaf(false) {};
+    const TargetValue *target;
+    WValueDistribution *dist;
+    const ValueDistribution *top;
+    double distance;
+    bool exact;
+    bool counted_exact;
+    bool tie;
+    bool has_depth;
+    size_t match_depth;
+    bool last_leaf;
+  };
+
+  class classifyCache {
+  public:
+    explicit classifyCache( size_t s ): limit(s), hits(0), lookups(0) {};
+    ~classifyCache() { clear(); };
+    bool lookup( const std::string&, cachedResult& );
+    void store( const std::string&, const cachedResult& );
+    void clear();
+    void resetCounts() { hits = 0; lookups = 0; };
+    size_t size() const { return lru.size(); };
+    size_t Limit() const { return limit; };
+    size_t Hits() const { return hits; };
+    size_t Lookups() const { return lookups; };
+  private:
+    classifyCache( const classifyCache& ); // inhibit copies
+    classifyCache& operator=( const classifyCache& ); // inhibit copies
+    typedef std::list<std::pair<std::string,cachedResult>> lru_list;
+    size_t limit;
+    size_t hits;
+    size_t lookups;
+    lru_list lru;
+    std::unordered_map<std::string, lru_list::iterator> index;
+  };
+
   class fCmp {
   public:
     bool operator()( const FeatureValue* F, const FeatureValue* G ) const{
@@ -106,11 +156,29 @@ namespace Timbl {
   std::ostream& operator<< ( std::ostream&, const fileDoubleIndex& );
 
   class threadData;
+  class DataCache;
+  class TimblExperiment;
+
+  class cacheScope {
+    // serves the lines of a datafile from the --data-cache of the
+    // experiment, while reading it through the given stream.
+    // When seekLine() will be used on a compressed file, its lines are
+    // served from memory, without a --data-cache too
+  public:
+    cacheScope( TimblExperiment *, const std::string&, std::istream&,
+		bool = false );
+    ~cacheScope();
+  private:
+    cacheScope( const cacheScope& );
+    cacheScope& operator=( const cacheScope& );
+    TimblExperiment *exp;
+  };
 
   class TimblExperiment: public MBLClass {
     friend class TimblAPI;
     friend class threadData;
     friend class threadBlock;
+    friend class cacheScope;
   public:
     virtual ~TimblExperiment();
     virtual TimblExperiment *clone() const = 0;
@@ -130,6 +198,13 @@ namespace Timbl {
 		       const std::string& );
     virtual bool NS_Test( const std::string&,
 			  const std::string& );
+    virtual const StatisticsClass& gridStatistics() const { return stats; };
+    bool SweepTest( const std::string&,
+		    const std::string& );
+    void setSweep( const std::vector<size_t>&,
+		   const std::vector<decayStruct *>&,
+		   bool );
+    bool Sweeping() const { return !sweep_k.empty(); };
     virtual void InitInstanceBase() = 0;
     virtual bool ReadInstanceBase( const std::string& );
     virtual bool WriteInstanceBase( const std::string& );
@@ -142,9 +217,20 @@ namespace Timbl {
     void Estimate( int e ){ estimate = e; };
     int Clones() const { return numOfThreads; };
     void Clones( int cl ) { numOfThreads = cl; };
+    size_t CacheSize() const { return cache_size; };
+    void CacheSize( size_t );
+    const std::string& DataCacheDir() const { return data_cache_dir; };
+    void DataCacheDir( const std::string& d ){ data_cache_dir = d; };
     void setOutPath( const std::string& s ){ outPath = s; };
     TimblExperiment *CreateClient( int  ) const;
     TimblExperiment *splitChild() const;
+    TimblExperiment *gridChild( TimblExperiment * ) const;
+    TimblExperiment *snapshotChild() const;
+    bool GridSearch( const std::string&,
+		     const std::string&,
+		     const std::vector<std::string>&,
+		     const std::vector<std::string>&,
+		     size_t = 0 );
     bool SetOptions( int, const char ** );
     bool SetOptions( const std::string& );
     bool SetOptions( const TiCC::CL_Options&  );
@@ -166,6 +252,9 @@ namespace Timbl {
     bool showBestNeighbors( std::ostream& ) const;
     xmlNode *bestNeighborsToXML() const;
     bool showStatistics( std::ostream& ) const;
+    void show_statistics( std::ostream&,
+			  const StatisticsClass&,
+			  const ConfusionMatrix * ) const;
     void showInputFormat( std::ostream& ) const;
     const std::string& ExpName() const { return exp_name; };
     void setExpName( const std::string& s ) { exp_name = s; };
@@ -207,12 +296,21 @@ namespace Timbl {
     }
 
     const neighborSet *NB_Classify( const std::string& );
+    size_t encodeFeatureValue( size_t, const std::string& ) const;
+    const TargetValue *classifyFields( const std::vector<std::string>&,
+				       double& );
+    const TargetValue *classifyValues( const std::vector<size_t>&, double& );
+    const ValueDistribution *resultDistribution() const {
+      return bestResult.rawDistribution();
+    };
 
     virtual void initExperiment( bool = false );
 
   protected:
     TimblExperiment( const AlgorithmType, const std::string& = "" );
-    virtual bool checkLine( const std::string& );
+    bool checkLine( const std::string& );
+    bool checkFields( size_t );
+    virtual bool checkTestable( InputFormatType );
     virtual bool ClassicLearn( const std::string& = "", bool = true );
     virtual const TargetValue *LocalClassify( const Instance& ,
 					      double&,
@@ -232,9 +330,15 @@ namespace Timbl {
 		       size_t = 0 );
     void normalizeResult();
     const neighborSet *LocalClassify( const Instance&  );
+    const TargetValue *cachedClassify( const Instance&, double&, bool& );
+    void clearCache();
     bool nextLine( std::istream &, std::string&, int& );
     bool nextLine( std::istream &, std::string& );
     bool skipARFFHeader( std::istream & );
+    std::streamsize linePos( std::istream& );
+    void seekLine( std::istream&, std::streamsize );
+    const DataCache *takeRow( size_t& );
+    bool chopRow( const DataCache *, size_t );
 
     void show_progress( std::ostream& os, time_t, unsigned int );
     bool createPercFile( const std::string& = "" ) const;
@@ -245,6 +349,11 @@ namespace Timbl {
     void show_ignore_info( std::ostream& os ) const;
     void show_weight_info( std::ostream& os ) const;
     void show_metric_info( std::ostream& os ) const;
+    void show_search_info( std::ostream& os ) const;
+    void initSearch();
+    void searchTreeOrder();
+    unsigned long orderCost( const std::vector<orderSample>&, size_t,
+			     const std::vector<size_t>& );
     double sum_remaining_weights( size_t ) const;
 
     bool build_file_index( const std::string&, fileIndex&  );
@@ -258,7 +367,7 @@ namespace Timbl {
     std::string outPath;
     std::string testStreamName;
     std::string outStreamName;
-    std::ifstream testStream;
+    DataStream testStream;
     std::ofstream outStream;
     unsigned long ibCount;
     ConfusionMatrix *confusionInfo;
@@ -267,11 +376,25 @@ namespace Timbl {
     resultStore bestResult;
     size_t match_depth;
     bool last_leaf;
+    classifyCache *result_cache;
 
   private:
     TimblExperiment( const TimblExperiment& );
     int estimate;
     int numOfThreads;
+    size_t cache_size;
+    std::string data_cache_dir;
+    std::map<std::string,DataCache*> data_caches;
+    DataCache *active_cache;
+    std::istream *cache_stream;
+    size_t cache_row;
+    bool row_pending;
+    std::vector<size_t> sweep_k;
+    std::vector<decayStruct *> sweep_decays;
+    bool sweep_files;
+    void attachCache( const std::string&, std::istream&, bool );
+    void detachCache();
+    void releaseCache( const std::string& );
     const TargetValue *classifyString( const std::string& , double& );
   };
 
@@ -292,7 +415,7 @@ namespace Timbl {
       return new IB1_Experiment( MaxFeats(), "", false );
     };
     bool checkTestFile();
-    bool checkLine( const std::string& );
+    bool checkTestable( InputFormatType );
     bool Increment( const Instance& I ) { return UnHideInstance( I ); };
     bool Decrement( const Instance& I ) { return HideInstance( I ); };
   private:
@@ -344,6 +467,8 @@ namespace Timbl {
 		    WeightType = GR_w,
 		    const std::string& = "" );
     AlgorithmType Algorithm() const { return CV_a; };
+    // a grid search ranks CV by all folds, stats only has the last one
+    const StatisticsClass& gridStatistics() const { return fold_total; };
   protected:
     bool checkTestFile();
     bool get_file_names( const std::string& );
@@ -354,6 +479,7 @@ namespace Timbl {
     std::string CV_WfileName;
     std::string CV_PfileName;
     WeightType CV_fileW;
+    StatisticsClass fold_total;
   };
 
   class TRIBL_Experiment: public TimblExperiment {
@@ -371,7 +497,7 @@ namespace Timbl {
     void showTestingInfo( std::ostream& );
     bool checkTestFile();
     AlgorithmType Algorithm() const { return TRIBL_a; };
-    bool checkLine( const std::string& );
+    bool checkTestable( InputFormatType );
     const TargetValue *LocalClassify( const Instance& ,
 				      double&,
 				      bool& );
@@ -393,7 +519,7 @@ namespace Timbl {
       return new TRIBL2_Experiment( MaxFeats(), "", false ); };
     bool checkTestFile();
     AlgorithmType Algorithm() const { return TRIBL2_a; };
-    bool checkLine( const std::string& );
+    bool checkTestable( InputFormatType );
     const TargetValue *LocalClassify( const Instance& ,
 				      double&,
 				      bool& );
@@ -425,7 +551,7 @@ namespace Timbl {
     bool ClassicLearn( const std::string& = "", bool = true );
     bool checkTestFile();
     void showTestingInfo( std::ostream& );
-    bool checkLine( const std::string& );
+    bool checkTestable( InputFormatType );
     bool sanityCheck() const;
     const TargetValue *LocalClassify( const Instance&,
 				      double&,
@@ -87,6 +87,7 @@ namespace Timbl {
 		      GREntropyOrder, IGEntropyOrder,
 		      X2Order, SVOrder, SDOrder,
 		      X2overFeature, SVoverFeature, SDoverFeature,
+		      SearchOrder,
 		      MaxOrdening };
 
   inline OrdeningType& operator++( OrdeningType &W ){
@@ -140,6 +140,7 @@ namespace Timbl {
 	Expand( FileNames[filenum] );
       string outName;
       string percName;
+      fold_total.clear();
       for ( size_t SkipFile = 0; SkipFile < NumOfFiles-1; ++SkipFile ) {
 	outName = correct_path( FileNames[SkipFile], outPath, false );
 	outName += ".cv";
@@ -155,6 +156,7 @@ namespace Timbl {
 	  result = createPercFile( percName );
 	if ( !result )
 	  return false;
+	fold_total.merge( stats );
 	set_verbosity( SILENT );
 	Expand( FileNames[SkipFile] );
 	Remove( FileNames[SkipFile+1] );
@@ -171,6 +173,8 @@ namespace Timbl {
       result = TimblExperiment::Test( FileNames[NumOfFiles-1], outName );
       if ( result )
 	result = createPercFile( percName );
+      if ( result )
+	fold_total.merge( stats );
     }
     return result;
   }
@@ -105,12 +105,21 @@ namespace Timbl{
     return result;
   }
 
+  static void strip_back( string& s ){
+    // like TiCC::trim_back(), but in place
+    string::size_type pos = s.find_last_not_of( " \t\r\n" );
+    if ( pos == string::npos )
+      s.clear();
+    else
+      s.erase( pos+1 );
+  }
+
   void Chopper::init( const string& s, size_t len, bool stripDot ) {
     vSize = len+1;
     choppedInput.resize(vSize);
     strippedInput = s;
     // trim spaces at end
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
     if ( stripDot ){
       // now trim at most 1 trailing dot
       auto it = strippedInput.end();
@@ -120,7 +129,22 @@ namespace Timbl{
       }
     }
     // trim more spaces at end
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
+  }
+
+  void Chopper::reset_sparse( const string& dflt ){
+    // only the features set by the previous line need a reset, unless
+    // the size changed
+    if ( sparse_size != vSize ){
+      for ( size_t m = 0; m < vSize-1; ++m )
+	choppedInput[m] = dflt;
+      sparse_size = vSize;
+    }
+    else {
+      for ( const auto& m : nonzero )
+	choppedInput[m] = dflt;
+    }
+    nonzero.clear();
   }
 
   static string extractWeight( const string& Buffer,
@@ -152,13 +176,12 @@ namespace Timbl{
 				 int F_length,
 				 bool chopTail ) {
     size_t result = 0;
-    string buffer;
+    string stripped;
     if ( chopTail ){
       string dummy;
-      buffer = extractWeight( inBuffer, dummy );
+      stripped = extractWeight( inBuffer, dummy );
     }
-    else
-      buffer = inBuffer;
+    const string& buffer = chopTail?stripped:inBuffer;
     size_t len = buffer.length();
     switch ( IF ){
     case ARFF:
@@ -239,7 +262,7 @@ namespace Timbl{
     vSize = len+1;
     choppedInput.resize(vSize);
     // trim trailing spaces
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
     string wght;
     strippedInput = extractWeight( strippedInput, wght );
     if ( wght.empty() ){
@@ -263,7 +286,7 @@ namespace Timbl{
       }
     }
     // trim more trailing spaces
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
   }
 
   void OccChopper::init( const string& s, size_t len, bool stripDot ) {
@@ -272,7 +295,7 @@ namespace Timbl{
     vSize = len+1;
     choppedInput.resize(vSize);
     // first trim trailing spaces
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
     string occS;
     // get occ
     strippedInput = extractOcc( strippedInput, occS );
@@ -297,14 +320,13 @@ namespace Timbl{
       }
     }
     // strip remaining trailing spaces
-    strippedInput = TiCC::trim_back( strippedInput );
+    strip_back( strippedInput );
   }
 
   bool C45_Chopper::chop( const string& InBuf, size_t len ){
     // Function that takes a line, and chops it up into substrings,
     // which represent the feature-values and the target-value.
     init( InBuf, len, true );
-    vector<string> splits;
     size_t res = TiCC::split_at( strippedInput, splits, "," );
     if ( res != vSize )
       return false;
@@ -335,12 +357,10 @@ namespace Timbl{
     // 12, 25, 333, bla.
     // the termination dot is optional
     init( InBuf, len, true );
-    for ( size_t m = 0; m < vSize-1; ++m )
-      choppedInput[m] = "0";
-    vector<string> parts;
-    TiCC::split_at( strippedInput, parts, ",", true );
-    for ( auto const& p : parts ){
-      if ( &p == &parts.back() ){
+    reset_sparse( "0" );
+    TiCC::split_at( strippedInput, splits, ",", true );
+    for ( auto const& p : splits ){
+      if ( &p == &splits.back() ){
 	choppedInput[vSize-1] = p;
 	break;
       }
@@ -348,8 +368,10 @@ namespace Timbl{
       if ( !TiCC::stringTo<size_t>( p, k, 1, vSize ) ){
 	return false;
       }
-      else
+      else {
 	choppedInput[k-1] = "1";
+	nonzero.push_back( k-1 );
+      }
     }
     return true;
   }
@@ -400,7 +422,6 @@ namespace Timbl{
     // Lines look like this:
     // one  two three bla
     init( InBuf, len, false );
-    vector<string> splits;
     size_t res = TiCC::split( strippedInput, splits );
     if ( res != vSize )
       return false;
@@ -424,7 +445,6 @@ namespace Timbl{
     // Lines look like this:
     // one  two three bla
     init( InBuf, len, false );
-    vector<string> splits;
     size_t res = TiCC::split_at( strippedInput, splits, "\t" );
     if ( res != vSize )
       return false;
@@ -447,8 +467,7 @@ namespace Timbl{
     // (12,value1) (25,value2) (333,value3) bla.
     // the termination dot is optional
     init( InBuf, len, true );
-    for ( size_t m = 0; m < vSize-1; ++m )
-      choppedInput[m] = DefaultSparseString;
+    reset_sparse( DefaultSparseString );
     choppedInput[vSize-1] = "";
     vector<string> entries;
     size_t num_ent = TiCC::split_at_first_of( strippedInput, entries, "()" );
@@ -478,6 +497,7 @@ namespace Timbl{
 	return false;
       }
       choppedInput[index-1] = StrToCode( parts[1] );
+      nonzero.push_back( index-1 );
     }
     return true;
   }
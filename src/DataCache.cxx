@@ -0,0 +1,466 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdio>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ticcutils/StringOps.h"
+#include "timbl/Common.h"
+#include "timbl/Types.h"
+#include "timbl/StringOps.h"
+#include "timbl/Choppers.h"
+#include "timbl/MBLClass.h"
+#include "timbl/DataCache.h"
+#include "timbl/DataStream.h"
+
+using namespace std;
+
+namespace Timbl {
+
+  static const char cache_magic[] = "TiMBL-DataCache";
+  static const uint32_t cache_version = 1;
+  static const uint32_t cache_order = 0x01020304;
+
+  DataCache::DataCache( const string& name, InputFormatType IF,
+			size_t num, int len, bool exw, bool occ ):
+    data_file( name ),
+    format( IF ),
+    num_feats( num ),
+    f_length( len ),
+    do_exw( exw ),
+    do_occ( occ ),
+    file_size( 0 ),
+    file_time( 0 ),
+    ready( false ),
+    skip_bad( false ),
+    cursor( 0 ),
+    head_skips( 0 ),
+    tail_gap( 0 )
+  {
+    stamp();
+  }
+
+  bool DataCache::matches( InputFormatType IF, size_t num, int len,
+			   bool exw, bool occ ) const {
+    return format == IF && num_feats == num && f_length == len
+      && do_exw == exw && do_occ == occ;
+  }
+
+  bool DataCache::stamp(){
+    struct stat st;
+    if ( stat( data_file.c_str(), &st ) != 0 ){
+      return false;
+    }
+    file_size = st.st_size;
+    file_time = st.st_mtime;
+    return true;
+  }
+
+  string DataCache::cacheName( const string& dir ) const {
+    // the basename of the datafile, plus a hash of the full name and the
+    // chopping settings, so different files with the same basename and
+    // different settings on the same file get their own cache
+    string base = data_file;
+    string::size_type pos = base.rfind( '/' );
+    if ( pos != string::npos ){
+      base.erase( 0, pos+1 );
+    }
+    ostringstream key;
+    key << data_file << "|" << format << "|" << num_feats << "|"
+	<< f_length << "|" << do_exw << "|" << do_occ;
+    ostringstream result;
+    result << dir;
+    if ( !dir.empty() && dir[dir.length()-1] != '/' ){
+      result << "/";
+    }
+    result << base << "." << hex << setw(16) << setfill('0')
+	   << std::hash<string>()( key.str() ) << ".tdc";
+    return result.str();
+  }
+
+  bool DataCache::next( size_t& gap, size_t& row ){
+    // like nextLine(): gives the next data row, and the number of
+    // skipped lines in front of it
+    gap = 0;
+    if ( cursor < exws.size() ){
+      gap = gaps[cursor];
+      row = cursor++;
+      return true;
+    }
+    if ( cursor == exws.size() ){
+      gap = tail_gap;
+      ++cursor;
+    }
+    return false;
+  }
+
+  void DataCache::restore( size_t row, Chopper *chopper ) const {
+    const unsigned int *b = &codes[0] + starts[row];
+    const unsigned int *e = &codes[0] + starts[row+1];
+    chopper->vSize = num_feats+1;
+    chopper->choppedInput.resize( chopper->vSize );
+    if ( format == Sparse || format == SparseBin ){
+      chopper->reset_sparse( format == Sparse?DefaultSparseString:"0" );
+      for ( ; b+1 < e; b += 2 ){
+	chopper->choppedInput[*b] = dict[b[1]];
+	chopper->nonzero.push_back( *b );
+      }
+      chopper->choppedInput[num_feats] = dict[*b];
+    }
+    else {
+      for ( size_t i = 0; i <= num_feats; ++i ){
+	chopper->choppedInput[i] = dict[b[i]];
+      }
+    }
+    chopper->setExW( exws[row] );
+    chopper->setOcc( occs[row] );
+  }
+
+  bool DataCache::build( string& msg, bool lenient ){
+    // read and chop the datafile the same way nextLine() and chopLine()
+    // would do.
+    // a file with unusable lines is not cached, so the usual warnings
+    // for those lines are still given. Unless lenient: then those lines
+    // are silently skipped, like empty ones
+    ready = false;
+    skip_bad = lenient;
+    DataStream is( data_file, ios::in );
+    if ( !is || !stamp() ){
+      msg = "can't open datafile: " + data_file;
+      return false;
+    }
+    Chopper *chopper = Chopper::create( format, do_exw, f_length, do_occ );
+    if ( !chopper ){
+      msg = "unsupported inputformat: " + TiCC::toString( format );
+      return false;
+    }
+    unordered_map<string,unsigned int> lookup;
+    dict.clear();
+    codes.clear();
+    starts.assign( 1, 0 );
+    gaps.clear();
+    exws.clear();
+    occs.clear();
+    head_skips = 0;
+    string line;
+    if ( format == ARFF ){
+      while ( getline( is, line ) &&
+	      !compare_nocase_n( "@DATA", line ) ){
+	++head_skips;
+      }
+    }
+    bool sparse = ( format == Sparse || format == SparseBin );
+    unsigned int gap = 0;
+    size_t line_nr = head_skips;
+    while ( getline( is, line ) ){
+      ++line_nr;
+      if ( empty_line( line, format ) ){
+	++gap;
+	continue;
+      }
+      bool ok = false;
+      try {
+	ok = chopper->chop( line, num_feats );
+      }
+      catch ( const exception& ){
+	ok = false;
+      }
+      if ( !ok && lenient ){
+	++gap;
+	continue;
+      }
+      if ( !ok ){
+	msg = "not cached, unusable line #" + TiCC::toString( line_nr )
+	  + " in " + data_file;
+	delete chopper;
+	return false;
+      }
+      if ( sparse ){
+	for ( const auto& j : chopper->nonZero() ){
+	  codes.push_back( j );
+	  auto it = lookup.insert( make_pair( chopper->getField( j ),
+					      dict.size() ) );
+	  if ( it.second )
+	    dict.push_back( chopper->getField( j ) );
+	  codes.push_back( it.first->second );
+	}
+	auto it = lookup.insert( make_pair( chopper->getField( num_feats ),
+					    dict.size() ) );
+	if ( it.second )
+	  dict.push_back( chopper->getField( num_feats ) );
+	codes.push_back( it.first->second );
+      }
+      else {
+	for ( size_t i = 0; i <= num_feats; ++i ){
+	  auto it = lookup.insert( make_pair( chopper->getField( i ),
+					      dict.size() ) );
+	  if ( it.second )
+	    dict.push_back( chopper->getField( i ) );
+	  codes.push_back( it.first->second );
+	}
+      }
+      starts.push_back( codes.size() );
+      gaps.push_back( gap );
+      exws.push_back( chopper->getExW() );
+      occs.push_back( chopper->getOcc() );
+      gap = 0;
+    }
+    tail_gap = gap;
+    delete chopper;
+    cursor = 0;
+    ready = true;
+    return true;
+  }
+
+  static void write_u64( ostream& os, uint64_t v ){
+    os.write( reinterpret_cast<const char *>(&v), sizeof(v) );
+  }
+
+  static bool read_u64( istream& is, uint64_t& v ){
+    return (bool)is.read( reinterpret_cast<char *>(&v), sizeof(v) );
+  }
+
+  template <class T>
+  static void write_vector( ostream& os, const vector<T>& v ){
+    write_u64( os, v.size() );
+    if ( !v.empty() ){
+      os.write( reinterpret_cast<const char *>(&v[0]), v.size()*sizeof(T) );
+    }
+  }
+
+  template <class T>
+  static bool read_vector( istream& is, vector<T>& v, uint64_t limit ){
+    // limit is the length of the file: no vector can be longer
+    uint64_t len;
+    if ( !read_u64( is, len ) || len > limit/sizeof(T) ){
+      return false;
+    }
+    v.resize( len );
+    if ( len > 0 ){
+      return (bool)is.read( reinterpret_cast<char *>(&v[0]),
+			    len*sizeof(T) );
+    }
+    return true;
+  }
+
+  static void write_string( ostream& os, const string& s ){
+    write_u64( os, s.length() );
+    os.write( s.data(), s.length() );
+  }
+
+  static bool read_string( istream& is, string& s, uint64_t limit ){
+    uint64_t len;
+    if ( !read_u64( is, len ) || len > limit ){
+      return false;
+    }
+    s.resize( len );
+    if ( len > 0 ){
+      return (bool)is.read( &s[0], len );
+    }
+    return true;
+  }
+
+  bool DataCache::save( const string& dir ) const {
+    if ( !ready ){
+      return false;
+    }
+    struct stat st;
+    if ( stat( dir.c_str(), &st ) != 0 ){
+      if ( mkdir( dir.c_str(), 0777 ) != 0 ){
+	return false;
+      }
+    }
+    else if ( !S_ISDIR( st.st_mode ) ){
+      return false;
+    }
+    string name = cacheName( dir );
+    // unique per writer, experiments may save the same cache concurrently
+    ostringstream tmp;
+    tmp << name << "." << getpid() << "." << (const void *)this << ".tmp";
+    string tmp_name = tmp.str();
+    {
+      ofstream os( tmp_name, ios::out | ios::binary );
+      if ( !os ){
+	return false;
+      }
+      os.write( cache_magic, sizeof(cache_magic) );
+      write_u64( os, cache_version );
+      write_u64( os, cache_order );
+      write_string( os, data_file );
+      write_u64( os, file_size );
+      write_u64( os, file_time );
+      write_u64( os, format );
+      write_u64( os, num_feats );
+      write_u64( os, f_length );
+      write_u64( os, do_exw );
+      write_u64( os, do_occ );
+      write_u64( os, head_skips );
+      write_u64( os, tail_gap );
+      write_u64( os, dict.size() );
+      for ( const auto& s : dict ){
+	write_string( os, s );
+      }
+      write_vector( os, starts );
+      write_vector( os, codes );
+      write_vector( os, gaps );
+      write_vector( os, exws );
+      write_vector( os, occs );
+      if ( !os ){
+	os.close();
+	remove( tmp_name.c_str() );
+	return false;
+      }
+    }
+    if ( rename( tmp_name.c_str(), name.c_str() ) != 0 ){
+      remove( tmp_name.c_str() );
+      return false;
+    }
+    return true;
+  }
+
+  bool DataCache::consistent() const {
+    // do the rows read from a cache file fit what restore() expects?
+    // starts must not decrease, a row must have the number of codes
+    // its format needs, and every code must be in range
+    if ( starts[0] != 0 ){
+      return false;
+    }
+    bool sparse = ( format == Sparse || format == SparseBin );
+    for ( size_t row = 0; row < exws.size(); ++row ){
+      if ( starts[row+1] < starts[row] ){
+	return false;
+      }
+      uint64_t len = starts[row+1] - starts[row];
+      const unsigned int *b = codes.data() + starts[row];
+      if ( sparse ){
+	// index/code pairs, followed by the code of the target
+	if ( len % 2 != 1 ){
+	  return false;
+	}
+	for ( ; len > 1; len -= 2, b += 2 ){
+	  if ( *b >= num_feats || b[1] >= dict.size() ){
+	    return false;
+	  }
+	}
+	if ( *b >= dict.size() ){
+	  return false;
+	}
+      }
+      else {
+	if ( len != num_feats+1 ){
+	  return false;
+	}
+	for ( ; len > 0; --len, ++b ){
+	  if ( *b >= dict.size() ){
+	    return false;
+	  }
+	}
+      }
+    }
+    return true;
+  }
+
+  bool DataCache::load( const string& dir ){
+    // only succeeds when the cache was made from the current version
+    // of the datafile, with the same settings
+    ready = false;
+    skip_bad = false;
+    if ( !stamp() ){
+      return false;
+    }
+    ifstream is( cacheName( dir ), ios::in | ios::binary );
+    if ( !is ){
+      return false;
+    }
+    // the lengths read from the file are checked against its size, so
+    // a damaged cache can't make us allocate huge amounts of memory
+    is.seekg( 0, ios::end );
+    uint64_t limit = is.tellg();
+    is.seekg( 0, ios::beg );
+    char magic[sizeof(cache_magic)];
+    if ( !is.read( magic, sizeof(magic) ) ||
+	 string( magic, sizeof(magic) ) != string( cache_magic,
+						   sizeof(cache_magic) ) ){
+      return false;
+    }
+    uint64_t version, order, size, time, IF, num, len, exw, occ;
+    string name;
+    if ( !read_u64( is, version ) || version != cache_version
+	 || !read_u64( is, order ) || order != cache_order
+	 || !read_string( is, name, limit ) || name != data_file
+	 || !read_u64( is, size ) || size != file_size
+	 || !read_u64( is, time ) || (int64_t)time != file_time
+	 || !read_u64( is, IF ) || IF != (uint64_t)format
+	 || !read_u64( is, num ) || num != num_feats
+	 || !read_u64( is, len ) || (int)len != f_length
+	 || !read_u64( is, exw ) || (bool)exw != do_exw
+	 || !read_u64( is, occ ) || (bool)occ != do_occ
+	 || !read_u64( is, head_skips )
+	 || !read_u64( is, tail_gap ) ){
+      return false;
+    }
+    uint64_t dict_size;
+    if ( !read_u64( is, dict_size )
+	 || dict_size > limit/sizeof(uint64_t) ){
+      // every string takes at least its length
+      return false;
+    }
+    dict.resize( dict_size );
+    for ( auto& s : dict ){
+      if ( !read_string( is, s, limit ) ){
+	return false;
+      }
+    }
+    if ( !read_vector( is, starts, limit )
+	 || !read_vector( is, codes, limit )
+	 || !read_vector( is, gaps, limit )
+	 || !read_vector( is, exws, limit )
+	 || !read_vector( is, occs, limit ) ){
+      return false;
+    }
+    if ( starts.size() != exws.size()+1
+	 || gaps.size() != exws.size()
+	 || occs.size() != exws.size()
+	 || starts.back() != codes.size()
+	 || !consistent() ){
+      return false;
+    }
+    cursor = 0;
+    ready = true;
+    return true;
+  }
+
+}
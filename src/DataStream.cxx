@@ -0,0 +1,375 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "config.h"
+#include "timbl/DataStream.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace Timbl {
+
+  enum Packing { Plain, Gzip, Zstd };
+
+  static const size_t chunk_size = 256*1024;
+  static const size_t queue_size = 4;
+
+  static Packing packing( const string& name ){
+    ifstream is( name, ios::in | ios::binary );
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    is.read( reinterpret_cast<char *>(magic), sizeof(magic) );
+    streamsize got = is.gcount();
+    if ( got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b ){
+      return Gzip;
+    }
+    if ( got == 4 && magic[0] == 0x28 && magic[1] == 0xb5
+	 && magic[2] == 0x2f && magic[3] == 0xfd ){
+      return Zstd;
+    }
+    return Plain;
+  }
+
+  bool compressed_file( const string& name ){
+    return packing( name ) != Plain;
+  }
+
+  class inflate_buf: public std::streambuf {
+    // a streambuf on a compressed file. A producer thread reads and
+    // decompresses the file, and queues the results in chunks of
+    // chunk_size bytes, at most queue_size of them
+  public:
+    inflate_buf( const string&, Packing );
+    ~inflate_buf();
+    bool good() const { return file.is_open(); };
+  protected:
+    int_type underflow();
+  private:
+    inflate_buf( const inflate_buf& );
+    inflate_buf& operator=( const inflate_buf& );
+    void produce();
+    bool deliver( string& );
+    string gunzip();
+    string unzstd();
+    string name;
+    Packing kind;
+    ifstream file;
+    mutex lock;
+    condition_variable changed;
+    deque<string> ready;
+    string current;
+    string error;
+    bool done;
+    bool stopping;
+    thread worker;
+  };
+
+  inflate_buf::inflate_buf( const string& n, Packing p ):
+    name( n ),
+    kind( p ),
+    file( n, ios::in | ios::binary ),
+    done( false ),
+    stopping( false )
+  {
+    if ( file.is_open() ){
+      worker = thread( &inflate_buf::produce, this );
+    }
+  }
+
+  inflate_buf::~inflate_buf(){
+    {
+      lock_guard<mutex> guard( lock );
+      stopping = true;
+    }
+    changed.notify_all();
+    if ( worker.joinable() ){
+      worker.join();
+    }
+  }
+
+  void inflate_buf::produce(){
+    string msg;
+    try {
+      if ( kind == Gzip ){
+	msg = gunzip();
+      }
+      else {
+	msg = unzstd();
+      }
+    }
+    catch ( const exception& e ){
+      msg = e.what();
+    }
+    lock_guard<mutex> guard( lock );
+    if ( !msg.empty() ){
+      error = "error reading compressed file " + name + ": " + msg;
+    }
+    done = true;
+    changed.notify_all();
+  }
+
+  bool inflate_buf::deliver( string& chunk ){
+    // queues chunk, after waiting for room.
+    // returns false when the reader has gone
+    unique_lock<mutex> guard( lock );
+    while ( !stopping && ready.size() >= queue_size ){
+      changed.wait( guard );
+    }
+    if ( stopping ){
+      return false;
+    }
+    ready.push_back( string() );
+    ready.back().swap( chunk );
+    changed.notify_all();
+    return true;
+  }
+
+  inflate_buf::int_type inflate_buf::underflow(){
+    if ( gptr() < egptr() ){
+      return traits_type::to_int_type( *gptr() );
+    }
+    unique_lock<mutex> guard( lock );
+    while ( ready.empty() && !done ){
+      changed.wait( guard );
+    }
+    if ( ready.empty() ){
+      if ( !error.empty() ){
+	throw runtime_error( error );
+      }
+      return traits_type::eof();
+    }
+    current.swap( ready.front() );
+    ready.pop_front();
+    changed.notify_all();
+    guard.unlock();
+    setg( &current[0], &current[0], &current[0] + current.size() );
+    return traits_type::to_int_type( *gptr() );
+  }
+
+  string inflate_buf::gunzip(){
+#ifdef HAVE_ZLIB
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    zs.next_in = Z_NULL;
+    zs.avail_in = 0;
+    // 15+32: the largest window, and a gzip or zlib header
+    if ( inflateInit2( &zs, 15+32 ) != Z_OK ){
+      return "zlib initialization failed";
+    }
+    vector<char> in( chunk_size );
+    string out( chunk_size, '\0' );
+    size_t used = 0;
+    bool need_input = true;
+    bool ended = false;
+    bool gone = false;
+    string msg;
+    while ( true ){
+      if ( zs.avail_in == 0 && need_input ){
+	file.read( &in[0], in.size() );
+	zs.avail_in = file.gcount();
+	zs.next_in = reinterpret_cast<Bytef *>(&in[0]);
+	if ( zs.avail_in == 0 ){
+	  break;
+	}
+      }
+      zs.next_out = reinterpret_cast<Bytef *>(&out[used]);
+      zs.avail_out = out.size() - used;
+      int ret = inflate( &zs, Z_NO_FLUSH );
+      used = out.size() - zs.avail_out;
+      // with room left in out, inflate() took all the input it could
+      need_input = ( zs.avail_out > 0 );
+      if ( ret == Z_STREAM_END ){
+	// a gzip file may hold several members, one after another
+	ended = true;
+	inflateReset( &zs );
+      }
+      else if ( ret == Z_OK ){
+	ended = false;
+      }
+      else if ( ret != Z_BUF_ERROR ){
+	msg = zs.msg ? zs.msg : "corrupt data";
+	break;
+      }
+      if ( used == out.size() ){
+	if ( !deliver( out ) ){
+	  gone = true;
+	  break;
+	}
+	out.assign( chunk_size, '\0' );
+	used = 0;
+      }
+    }
+    inflateEnd( &zs );
+    if ( msg.empty() && !gone ){
+      if ( file.bad() ){
+	msg = "read failure";
+      }
+      else if ( !ended ){
+	msg = "unexpected end of file";
+      }
+      else if ( used > 0 ){
+	out.resize( used );
+	deliver( out );
+      }
+    }
+    return msg;
+#else
+    return "timbl is built without zlib support";
+#endif
+  }
+
+  string inflate_buf::unzstd(){
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zs = ZSTD_createDStream();
+    if ( !zs ){
+      return "zstd initialization failed";
+    }
+    ZSTD_initDStream( zs );
+    vector<char> in( ZSTD_DStreamInSize() );
+    ZSTD_inBuffer input = { &in[0], 0, 0 };
+    string out( chunk_size, '\0' );
+    size_t used = 0;
+    bool need_input = true;
+    size_t last = 0;
+    bool gone = false;
+    string msg;
+    while ( true ){
+      if ( input.pos == input.size && need_input ){
+	file.read( &in[0], in.size() );
+	input.size = file.gcount();
+	input.pos = 0;
+	if ( input.size == 0 ){
+	  break;
+	}
+      }
+      ZSTD_outBuffer output = { &out[used], out.size() - used, 0 };
+      last = ZSTD_decompressStream( zs, &output, &input );
+      if ( ZSTD_isError( last ) ){
+	msg = ZSTD_getErrorName( last );
+	break;
+      }
+      used += output.pos;
+      // with room left in out, all buffered output is flushed
+      need_input = ( output.pos < output.size );
+      if ( used == out.size() ){
+	if ( !deliver( out ) ){
+	  gone = true;
+	  break;
+	}
+	out.assign( chunk_size, '\0' );
+	used = 0;
+      }
+    }
+    ZSTD_freeDStream( zs );
+    if ( msg.empty() && !gone ){
+      if ( file.bad() ){
+	msg = "read failure";
+      }
+      else if ( last != 0 ){
+	// 0 marks the end of a frame
+	msg = "unexpected end of file";
+      }
+      else if ( used > 0 ){
+	out.resize( used );
+	deliver( out );
+      }
+    }
+    return msg;
+#else
+    return "timbl is built without zstd support";
+#endif
+  }
+
+  DataStream::DataStream(): istream( 0 ), zbuf( 0 ) {
+    rdbuf( &fbuf );
+  }
+
+  DataStream::DataStream( const string& name, ios::openmode mode ):
+    istream( 0 ), zbuf( 0 ) {
+    rdbuf( &fbuf );
+    open( name, mode );
+  }
+
+  DataStream::~DataStream(){
+    close();
+  }
+
+  void DataStream::open( const string& name, ios::openmode mode ){
+    close();
+    Packing kind = packing( name );
+    if ( kind == Plain ){
+      rdbuf( &fbuf );
+      if ( !fbuf.open( name, mode | ios::in ) ){
+	setstate( ios::failbit );
+      }
+      return;
+    }
+    zbuf = new inflate_buf( name, kind );
+    if ( !zbuf->good() ){
+      delete zbuf;
+      zbuf = 0;
+      setstate( ios::failbit );
+      return;
+    }
+    rdbuf( zbuf );
+    // corrupt data is an error, not the end of the file
+    exceptions( ios::badbit );
+  }
+
+  bool DataStream::is_open() const {
+    return zbuf != 0 || fbuf.is_open();
+  }
+
+  void DataStream::close(){
+    if ( zbuf ){
+      exceptions( ios::goodbit );
+      rdbuf( &fbuf );
+      delete zbuf;
+      zbuf = 0;
+    }
+    if ( fbuf.is_open() && !fbuf.close() ){
+      setstate( ios::failbit );
+    }
+  }
+
+}
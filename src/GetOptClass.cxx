@@ -63,6 +63,9 @@ namespace Timbl {
     BeamSize = 0;
     clip_freq = 10;
     clones = 1;
+    bound_levels = -1;
+    linear_scan = -1;
+    cache_size = -1;
     bootstrap_lines = -1;
     local_progress = 100000;
     seed = -1;
@@ -78,6 +81,9 @@ namespace Timbl {
     do_sloppy_loo = false;
     do_silly = false;
     do_diversify = false;
+    do_exact_index = false;
+    do_best_first = false;
+    do_compile = false;
     if ( MaxFeats == -1 ){
       MaxFeats = Max;
       LocalInputFormat = UnknownInputFormat; // InputFormat and verbosity
@@ -90,6 +96,11 @@ namespace Timbl {
     }
     outPath = "";
     occIn = 0;
+    sweep_neigh.clear();
+    sweep_decay.clear();
+    sweep_alfa.clear();
+    sweep_beta.clear();
+    do_sweep_out = false;
   }
 
   GetOptClass::GetOptClass( const TiCC::CL_Options& opts ):
@@ -135,6 +146,9 @@ namespace Timbl {
     maxbests( in.maxbests ),
     clip_freq( in.clip_freq ),
     clones( in.clones ),
+    bound_levels( in.bound_levels ),
+    linear_scan( in.linear_scan ),
+    cache_size( in.cache_size ),
     BinSize( in.BinSize ),
     BeamSize( in.BeamSize ),
     bootstrap_lines( in.bootstrap_lines ),
@@ -159,10 +173,19 @@ namespace Timbl {
     do_sloppy_loo( false ),
     do_silly( in.do_silly ),
     do_diversify( in.do_diversify ),
+    do_exact_index( in.do_exact_index ),
+    do_best_first( in.do_best_first ),
+    do_compile( in.do_compile ),
     metricsArray( in.metricsArray ),
     parent_socket_os( in.parent_socket_os ),
     outPath( in.outPath ),
-    occIn( in.occIn )
+    dataCacheDir( in.dataCacheDir ),
+    occIn( in.occIn ),
+    sweep_neigh( in.sweep_neigh ),
+    sweep_decay( in.sweep_decay ),
+    sweep_alfa( in.sweep_alfa ),
+    sweep_beta( in.sweep_beta ),
+    do_sweep_out( in.do_sweep_out )
   {
   }
 
@@ -172,6 +195,24 @@ namespace Timbl {
     return result;
   }
 
+  GetOptClass *GetOptClass::gridClone( bool own_algo ) const{
+    // a copy for one setting of a grid search, which sets all its
+    // options again on a new experiment. So it also needs the ones
+    // Clone() leaves out.
+    // With own_algo the setting has an -a of its own, which then
+    // starts from IB1, as on the command line. (LOO and CV stay)
+    GetOptClass *result = Clone();
+    result->target_pos = target_pos;
+    result->N_present = N_present;
+    result->do_all_weights = do_all_weights;
+    result->do_sloppy_loo = do_sloppy_loo;
+    if ( own_algo &&
+	 local_algo != LOO_a && local_algo != CV_a ){
+      result->local_algo = IB1_a;
+    }
+    return result;
+  }
+
   void GetOptClass::Error( const string& out_line ) const {
     if ( parent_socket_os )
       *parent_socket_os << "ERROR { " << out_line << " }" << endl;
@@ -180,6 +221,19 @@ namespace Timbl {
     }
   }
 
+  static decayStruct *make_decay( DecayType type, double alfa, double beta ){
+    switch ( type ){
+    case InvDist:
+      return new invDistDecay();
+    case InvLinear:
+      return new invLinDecay();
+    case ExpDecay:
+      return new expDecay( alfa, beta );
+    default:
+      return new zeroDecay();
+    }
+  }
+
   bool GetOptClass::definitive_options( TimblExperiment *Exp ){
     if ( opt_changed || !opt_init ){
       opt_changed = false;
@@ -238,6 +292,11 @@ namespace Timbl {
 	  if (!Exp->SetOption( optline ))
 	    return false;
 	}
+	if ( do_exact_index ){
+	  optline = "EXACT_INDEX: true";
+	  if (!Exp->SetOption( optline ))
+	    return false;
+	}
 	if ( f_length > 0 ){
 	  optline = "FLENGTH: " + TiCC::toString<int>(f_length);
 	  if (!Exp->SetOption( optline ))
@@ -281,6 +340,12 @@ namespace Timbl {
 	  optline = "IG_THRESHOLD: " + TiCC::toString<int>(igThreshold);
 	  Exp->SetOption( optline );
 	}
+	if ( local_order == SearchOrder &&
+	     ( local_algo == IGTREE_a || local_algo == TRIBL_a
+	       || local_algo == TRIBL2_a ) ){
+	  Error( "--Treeorder=SCO is only valid for IB1, IB2, LOO and CV" );
+	  return false;
+	}
 	if ( local_order != UnknownOrdening ){
 	  optline = "TREE_ORDER: " + TiCC::toString(local_order);
 	  Exp->SetOption( optline );
@@ -291,6 +356,40 @@ namespace Timbl {
       }
       if ( clones > 0 )
 	Exp->Clones( clones );
+      if ( cache_size >= 0 &&
+	   Exp->CacheSize() != (size_t)cache_size )
+	Exp->CacheSize( cache_size );
+      if ( !dataCacheDir.empty() )
+	Exp->DataCacheDir( dataCacheDir );
+      if ( !sweep_neigh.empty() || !sweep_decay.empty() ){
+	if ( local_algo != IB1_a && local_algo != IB2_a ){
+	  Error( "a list of values for -k or -d is only valid for the IB1 and IB2 algorithms" );
+	  return false;
+	}
+	if ( myVerbosity & (NEAR_N|ALL_K) ){
+	  Error( "a list of values for -k or -d cannot be combined with +vn or +vk" );
+	  return false;
+	}
+	vector<size_t> ks;
+	if ( sweep_neigh.empty() )
+	  ks.push_back( no_neigh );
+	else
+	  ks.assign( sweep_neigh.begin(), sweep_neigh.end() );
+	vector<decayStruct *> decays;
+	if ( sweep_decay.empty() )
+	  decays.push_back( make_decay( local_decay,
+					local_decay_alfa, local_decay_beta ) );
+	else {
+	  for ( size_t i=0; i < sweep_decay.size(); ++i ){
+	    decays.push_back( make_decay( sweep_decay[i],
+					  sweep_alfa[i], sweep_beta[i] ) );
+	  }
+	}
+	Exp->setSweep( ks, decays, do_sweep_out );
+      }
+      else if ( Exp->Sweeping() ){
+	Exp->setSweep( vector<size_t>(), vector<decayStruct *>(), false );
+      }
       if ( estimate < 10 )
 	Exp->Estimate( 0 );
       else
@@ -335,6 +434,22 @@ namespace Timbl {
 	Exp->SetOption(  "HASHED_TREE: true" );
       else
 	Exp->SetOption(  "HASHED_TREE: false" );
+      if ( do_best_first )
+	Exp->SetOption(  "BEST_FIRST: true" );
+      else
+	Exp->SetOption(  "BEST_FIRST: false" );
+      if ( bound_levels >= 0 )
+	Exp->SetOption( "BOUND_LEVELS: " + TiCC::toString(bound_levels) );
+      Exp->SetOption( "LINEAR_SCAN: " + TiCC::toString(linear_scan) );
+      if ( do_compile ){
+	if ( local_algo != IGTREE_a ){
+	  Error( "--compile is only valid for the IGTree algorithm" );
+	  return false;
+	}
+	Exp->SetOption(  "COMPILE_IGTREE: true" );
+      }
+      else
+	Exp->SetOption(  "COMPILE_IGTREE: false" );
       if ( occIn > 0 &&
 	   do_sample_weights ){
 	Error( "--occurrences and -s cannot be combined!" );
@@ -423,6 +538,48 @@ namespace Timbl {
     return true;
   }
 
+  static bool parse_decay( const string& opt_val,
+			   DecayType& decay,
+			   double& alfa,
+			   double& beta ){
+    string::size_type pos1 = opt_val.find( ":" );
+    if ( pos1 == string::npos ){
+      pos1 = opt_val.find_first_of( "0123456789" );
+      if ( pos1 != string::npos ){
+	return ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
+					    decay ) &&
+		 TiCC::stringTo<double>( string( opt_val, pos1 ),
+					 alfa ) );
+      }
+      else {
+	return TiCC::stringTo<DecayType>( opt_val, decay );
+      }
+    }
+    else {
+      string::size_type pos2 = opt_val.find( ':', pos1+1 );
+      if ( pos2 == string::npos ){
+	pos2 = opt_val.find_first_of( "0123456789", pos1+1 );
+	if ( pos2 != string::npos ){
+	  return ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
+					      decay ) &&
+		   TiCC::stringTo<double>( string( opt_val, pos2 ),
+					   alfa ) );
+	}
+	else {
+	  return false;
+	}
+      }
+      else {
+	return ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
+					    decay ) &&
+		 TiCC::stringTo<double>( string( opt_val, pos1+1, pos2-pos1-1 ),
+					 alfa ) &&
+		 TiCC::stringTo<double>( string( opt_val, pos2+1 ),
+					 beta ) );
+      }
+    }
+  }
+
   inline bool GetOptClass::parse_range( string& line,
 					string::iterator& it,
 					MetricType Value ){
@@ -698,10 +855,24 @@ namespace Timbl {
 	  break;
 
 	case 'b':
-	  bootstrap_lines = TiCC::stringTo<int>( opt_val );
-	  if ( bootstrap_lines < 1 ){
-	    Error( "illegal value for -b option: " + opt_val );
-	    return false;
+	  if ( longOpt ){
+	    if ( long_option == "bestfirst" )
+	      do_best_first = true;
+	    else if ( long_option == "bounds" ){
+	      if ( !TiCC::stringTo<int>( opt_val, bound_levels )
+		   || bound_levels < 0 ){
+		Error( "invalid value for --bounds option: '"
+		       + opt_val + "'" );
+		return false;
+	      }
+	    }
+	  }
+	  else {
+	    bootstrap_lines = TiCC::stringTo<int>( opt_val );
+	    if ( bootstrap_lines < 1 ){
+	      Error( "illegal value for -b option: " + opt_val );
+	      return false;
+	    }
 	  }
 	  break;
 
@@ -730,7 +901,18 @@ namespace Timbl {
 
 	case 'c':
 	  if ( longOpt ){
-	    if ( long_option == "clones" ){
+	    if ( long_option == "cache" ){
+	      if ( !TiCC::stringTo<int>( opt_val, cache_size )
+		   || cache_size < 0 ){
+		Error( "invalid value for --cache option: '"
+		       + opt_val + "'" );
+		return false;
+	      }
+	    }
+	    else if ( long_option == "compile" ){
+	      do_compile = true;
+	    }
+	    else if ( long_option == "clones" ){
 	      if ( !TiCC::stringTo<int>( opt_val, clones )
 		   || clones <= 0 ){
 		Error( "invalid value for --clones option: '"
@@ -749,52 +931,47 @@ namespace Timbl {
 	  break;
 
 	case 'd': {
-	  string::size_type pos1 = opt_val.find( ":" );
-	  if ( pos1 == string::npos ){
-	    pos1 = opt_val.find_first_of( "0123456789" );
-	    if ( pos1 != string::npos ){
-	      if ( ! ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
-					    local_decay ) &&
-		       TiCC::stringTo<double>( string( opt_val, pos1 ),
-					 local_decay_alfa ) ) ){
-		Error( "illegal value for -d option: " + opt_val );
+	  if ( longOpt ){
+	    if ( long_option == "data-cache" ){
+	      if ( opt_val.empty() ){
+		Error( "missing directory for --data-cache option" );
 		return false;
 	      }
+	      dataCacheDir = opt_val;
 	    }
-	    else if ( !TiCC::stringTo<DecayType>( opt_val, local_decay ) ){
+	    break;
+	  }
+	  vector<string> parts;
+	  if ( TiCC::split_at( opt_val, parts, "," ) == 0 ){
+	    Error( "illegal value for -d option: " + opt_val );
+	    return false;
+	  }
+	  sweep_decay.clear();
+	  sweep_alfa.clear();
+	  sweep_beta.clear();
+	  for ( const auto& part : parts ){
+	    DecayType dt = local_decay;
+	    double alfa = local_decay_alfa;
+	    double beta = local_decay_beta;
+	    if ( !parse_decay( part, dt, alfa, beta ) ){
 	      Error( "illegal value for -d option: " + opt_val );
 	      return false;
 	    }
+	    if ( parts.size() > 1 ){
+	      // a list of decays: sweep over them
+	      sweep_decay.push_back( dt );
+	      sweep_alfa.push_back( alfa );
+	      sweep_beta.push_back( beta );
+	    }
+	  }
+	  if ( parts.size() > 1 ){
+	    local_decay = sweep_decay[0];
+	    local_decay_alfa = sweep_alfa[0];
+	    local_decay_beta = sweep_beta[0];
 	  }
 	  else {
-	    string::size_type pos2 = opt_val.find( ':', pos1+1 );
-	    if ( pos2 == string::npos ){
-	      pos2 = opt_val.find_first_of( "0123456789", pos1+1 );
-	      if ( pos2 != string::npos ){
-		if ( ! ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
-					      local_decay ) &&
-			 TiCC::stringTo<double>( string( opt_val, pos2 ),
-					   local_decay_alfa ) ) ){
-		  Error( "illegal value for -d option: " + opt_val );
-		  return false;
-		}
-	      }
-	      else {
-		Error( "illegal value for -d option: " + opt_val );
-		return false;
-	      }
-	    }
-	    else {
-	      if ( ! ( TiCC::stringTo<DecayType>( string( opt_val, 0, pos1 ),
-					    local_decay ) &&
-		       TiCC::stringTo<double>( string( opt_val, pos1+1, pos2-pos1-1 ),
-					 local_decay_alfa ) &&
-		       TiCC::stringTo<double>( string( opt_val, pos2+1 ),
-					 local_decay_beta ) ) ){
-		Error( "illegal value for -d option: " + opt_val );
-		return false;
-	      }
-	    }
+	    parse_decay( parts[0], local_decay,
+			 local_decay_alfa, local_decay_beta );
 	  }
 	  break;
 	}
@@ -814,8 +991,12 @@ namespace Timbl {
 	  break;
 
 	case 'e':
-	  if ( !TiCC::stringTo<int>( opt_val, estimate )
-	       || estimate < 0 ){
+	  if ( longOpt ){
+	    if ( long_option == "exactindex" )
+	      do_exact_index = true;
+	  }
+	  else if ( !TiCC::stringTo<int>( opt_val, estimate )
+		    || estimate < 0 ){
 	    Error( "illegal value for -e option: " + opt_val );
 	    return false;
 	  }
@@ -857,13 +1038,30 @@ namespace Timbl {
 	  do_hashed = mood;
 	  break;
 
-	case 'k':
-	  if ( !TiCC::stringTo<int>( opt_val, no_neigh )
-	       || no_neigh <= 0 ){
+	case 'k': {
+	  vector<string> parts;
+	  if ( TiCC::split_at( opt_val, parts, "," ) == 0 ){
 	    Error( "illegal value for -k option: " + opt_val );
 	    return false;
 	  }
+	  sweep_neigh.clear();
+	  int max_k = 0;
+	  for ( const auto& part : parts ){
+	    int k;
+	    if ( !TiCC::stringTo<int>( part, k )
+		 || k <= 0 ){
+	      Error( "illegal value for -k option: " + opt_val );
+	      return false;
+	    }
+	    if ( parts.size() > 1 ){
+	      // a list of k's: sweep over them, searching for the largest
+	      sweep_neigh.push_back( k );
+	    }
+	    max_k = max( max_k, k );
+	  }
+	  no_neigh = max_k;
 	  break;
+	}
 
 	case 'l':
 	  if ( !TiCC::stringTo<int>( opt_val, f_length )
@@ -962,6 +1160,21 @@ namespace Timbl {
 	      }
 	      do_sloppy_loo = val;
 	    }
+	    else if ( long_option == "scan" ){
+	      bool val;
+	      if ( TiCC::uppercase( opt_val ) == "AUTO" )
+		linear_scan = -1;
+	      else if ( isBoolOrEmpty(opt_val,val) )
+		linear_scan = val?1:0;
+	      else {
+		Error( "invalid value for scan: '"
+		       + opt_val + "'" );
+		return false;
+	      }
+	    }
+	    else if ( long_option == "sweep-out" ){
+	      do_sweep_out = true;
+	    }
 	    else if ( long_option == "silly" ){
 	      bool val;
 	      if ( !isBoolOrEmpty(opt_val,val) ){
@@ -0,0 +1,306 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "config.h"
+
+#include "timbl/MsgClass.h"
+#include "timbl/Common.h"
+#include "timbl/Types.h"
+#include "timbl/Options.h"
+#include "timbl/Instance.h"
+#include "timbl/Statistics.h"
+#include "timbl/neighborSet.h"
+#include "timbl/BestArray.h"
+#include "timbl/IBtree.h"
+#include "timbl/MBLClass.h"
+#include "ticcutils/CommandLine.h"
+#include "timbl/GetOptClass.h"
+#include "timbl/TimblExperiment.h"
+#include "ticcutils/Timer.h"
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace Timbl {
+
+  TimblExperiment *TimblExperiment::gridChild( TimblExperiment *exp ) const {
+    //
+    // a child with the settings of exp, which builds its own InstanceBase
+    // from our prepared data. Feature values, targets and probability
+    // arrays are shared, and only read.
+    // Returns 0 when exp cannot use our data.
+    //
+    switch ( exp->Algorithm() ){
+    case IB1_a:
+    case TRIBL_a:
+    case TRIBL2_a:
+    case IGTREE_a:
+      break;
+    default:
+      return 0;
+    }
+    for ( size_t j=0; j < NumOfFeatures(); ++j ){
+      if ( Features[j]->Ignore() && exp->userMetric( j ) != Ignore ){
+	// we didn't prepare this feature
+	return 0;
+      }
+    }
+    TimblExperiment *result = exp->clone();
+    *result = *this;
+    result->algorithm = exp->algorithm;
+    result->TreeOrder = exp->TreeOrder;
+    result->OptParams = exp->OptParams;
+    result->OptParams->reInit();
+    result->CurrentDataFile = "";
+    result->result_cache = 0;
+    result->cache_size = 0;
+    if ( result->InstanceBase ){
+      result->InstanceBase->CleanPartition( false );
+      result->InstanceBase = 0;
+    }
+    result->is_synced = true;
+    for ( auto const& feat : result->Features ){
+      feat->unshare();
+    }
+    if ( !result->ConfirmOptions() ){
+      result->OptParams = 0;
+      delete result;
+      return 0;
+    }
+    exp->OptParams = 0;
+    result->set_feature_metrics();
+    return result;
+  }
+
+  class gridSetting {
+  public:
+    gridSetting(): opts(0), ok(false), shared(false),
+		   learn_time(0), test_time(0) {};
+    double accuracy() const {
+      if ( stats.dataLines() == 0 )
+	return 0.0;
+      return stats.testedCorrect()/(double)stats.dataLines();
+    }
+    string setting;
+    string outFile;
+    GetOptClass *opts;
+    StatisticsClass stats;
+    bool ok;
+    bool shared;
+    long long learn_time;
+    long long test_time;
+  };
+
+  static bool better_setting( const gridSetting *a, const gridSetting *b ){
+    if ( a->ok != b->ok )
+      return a->ok;
+    return a->accuracy() > b->accuracy();
+  }
+
+  bool TimblExperiment::GridSearch( const string& dataFile,
+				    const string& testFile,
+				    const vector<string>& settings,
+				    const vector<string>& outFiles,
+				    size_t memory ){
+    //
+    // try every setting on the same data, and rank them by accuracy.
+    // settings for IB1, IGTREE and TRIBL(2) share the data we prepare,
+    // the others (IB2, LOO and CV) run as separate experiments.
+    // memory is a budget in megabytes: no more settings are run
+    // concurrently than fit in it.
+    //
+    if ( settings.empty() ){
+      Error( "GridSearch: no settings to try" );
+      return false;
+    }
+    if ( ExpInvalid() || !ConfirmOptions() )
+      return false;
+    if ( Sweeping() ){
+      Error( "a grid search cannot be combined with a list of values for -k or -d" );
+      return false;
+    }
+    bool cross = ( Algorithm() == CV_a );
+    bool shared = ( Algorithm() == IB1_a || Algorithm() == IGTREE_a ||
+		    Algorithm() == TRIBL_a || Algorithm() == TRIBL2_a );
+    vector<gridSetting> grid( settings.size() );
+    for ( size_t i=0; i < settings.size(); ++i ){
+      grid[i].setting = settings[i];
+      if ( i < outFiles.size() )
+	grid[i].outFile = outFiles[i];
+      TiCC::CL_Options opts( timbl_short_opts, timbl_long_opts );
+      try {
+	opts.init( settings[i] );
+      }
+      catch ( exception& e ){
+	Error( "grid setting '" + settings[i] + "': " + e.what() );
+	continue;
+      }
+      GetOptClass *go = OptParams->gridClone( opts.is_present( 'a' ) );
+      if ( go->parse_options( opts ) ){
+	go->reInit();
+	grid[i].opts = go;
+      }
+      else {
+	Error( "invalid grid setting: '" + settings[i] + "'" );
+	delete go;
+      }
+    }
+    TiCC::Timer prepT;
+    size_t estimate = 0;
+    if ( !cross ){
+      prepT.start();
+      if ( CurrentDataFile.empty() && !Prepare( dataFile ) )
+	return false;
+      if ( shared && !initSharedArrays() ){
+	Error( "not enough memory for Probability Arrays" );
+	return false;
+      }
+      prepT.stop();
+      // an upper bound: a tree with a separate path for every instance
+      estimate = Targets->TotalValues() * ( NumOfFeatures() + 1 )
+	* sizeof(IBtree);
+    }
+    int threads = 1;
+    if ( !cross ){
+      threads = min( max( 1, Clones() ), (int)grid.size() );
+      if ( memory > 0 && estimate > 0 ){
+	size_t fit = max( (size_t)1, memory*1024*1024/estimate );
+	if ( fit < (size_t)threads )
+	  threads = fit;
+      }
+    }
+    if ( !Verbosity(SILENT) ){
+      Info( "Grid search over " + TiCC::toString( grid.size() )
+	    + " settings, running " + TiCC::toString( threads )
+	    + " at a time" );
+    }
+#pragma omp parallel for num_threads( threads ) schedule( dynamic )
+    for ( int i=0; i < (int)grid.size(); ++i ){
+      gridSetting& gs = grid[i];
+      if ( !gs.opts )
+	continue;
+      TimblExperiment *exp = 0;
+      bool ok = false;
+#pragma omp critical (grid_setup)
+      {
+	AlgorithmType algo = gs.opts->Algo();
+	if ( algo == Unknown_a )
+	  algo = IB1_a;
+	exp = Create_Pimpl( algo, "", gs.opts );
+	if ( !exp )
+	  delete gs.opts;
+	gs.opts = 0;
+	if ( exp && exp->ConfirmOptions() ){
+	  ok = true;
+	  if ( shared ){
+	    TimblExperiment *child = gridChild( exp );
+	    if ( child ){
+	      delete exp;
+	      exp = child;
+	      gs.shared = true;
+	    }
+	  }
+	  exp->set_verbosity( exp->get_verbosity() | SILENT );
+	  exp->Clones( 1 );
+	}
+      }
+      try {
+	TiCC::Timer learnT;
+	TiCC::Timer testT;
+	if ( ok && !cross ){
+	  learnT.start();
+	  ok = exp->Learn( dataFile );
+	  learnT.stop();
+	}
+	if ( ok ){
+	  testT.start();
+	  ok = exp->Test( testFile, gs.outFile );
+	  testT.stop();
+	}
+	gs.learn_time = learnT.usecs();
+	gs.test_time = testT.usecs();
+	if ( ok )
+	  gs.stats = exp->gridStatistics();
+      }
+      catch ( exception& e ){
+	Error( "grid setting '" + gs.setting + "': " + e.what() );
+	ok = false;
+      }
+      gs.ok = ok;
+      delete exp;
+    }
+    vector<const gridSetting *> ranked;
+    for ( const auto& gs : grid ){
+      ranked.push_back( &gs );
+    }
+    stable_sort( ranked.begin(), ranked.end(), better_setting );
+    if ( !ranked[0]->ok ){
+      Error( "none of the grid settings succeeded" );
+      return false;
+    }
+    stats = ranked[0]->stats;
+    if ( !Verbosity(SILENT) ){
+      if ( !cross ){
+	*mylog << "Preparing the data took: " << prepT << endl;
+      }
+      *mylog << endl << "Grid search results:" << endl
+	     << "rank  accuracy    correct/tested    learn(s)   test(s)  setting"
+	     << endl;
+      int rank = 0;
+      for ( const auto& gs : ranked ){
+	ostringstream line;
+	line << setw(4) << ++rank << "  ";
+	if ( gs->ok ){
+	  line << fixed << setprecision(6) << gs->accuracy()
+	       << setw(11) << gs->stats.testedCorrect() << "/" << left
+	       << setw(7) << gs->stats.dataLines() << right
+	       << setprecision(2) << setw(10) << gs->learn_time/1000000.0
+	       << setw(10) << gs->test_time/1000000.0 << "  ";
+	}
+	else {
+	  line << left << setw(56) << "failed" << right;
+	}
+	line << gs->setting;
+	if ( !gs->outFile.empty() )
+	  line << " (" << gs->outFile << ")";
+	*mylog << line.str() << endl;
+      }
+    }
+    return true;
+  }
+
+}
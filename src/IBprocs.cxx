@@ -30,6 +30,7 @@
 #include <vector>
 #include <map>
 #include <cassert>
+#include <cmath>
 
 #include "ticcutils/StringOps.h"
 #include "timbl/IBtree.h"
@@ -41,20 +42,41 @@ using namespace std;
 
 namespace Timbl {
 
+  void MBLClass::refresh_arrays( const Instance& Inst ){
+    // Only the values of Inst got another distribution. Update their
+    // probabilities and VD matrix rows, when possible, instead of
+    // rebuilding all arrays and matrices in initExperiment()
+    size_t Dim = Targets->ValuesArray.size();
+    for ( size_t i=0; i < effective_feats; ++i ){
+      Feature *feat = PermFeatures[i];
+      size_t clip = 0;
+      if ( !feat->Ignore() &&
+	   !feat->isNumerical() ){
+	clip = (int)rint( clip_factor *
+			  log( (double)feat->EffectiveValues() ) );
+      }
+      if ( do_sloppy_loo ||
+	   !feat->refresh_value( Inst.FV[i], Dim, clip, mvd_threshold ) ){
+	feat->clear_matrix();
+      }
+    }
+  }
+
   bool MBLClass::HideInstance( const Instance& Inst ){
     bool result = true;
     InstanceBase->RemoveInstance( Inst );
     MBL_init = do_sloppy_loo; // must be only true if you are REALY sure
     for ( size_t i=0; i < effective_feats && result; ++i ){
-      PermFeatures[i]->clear_matrix();
       if ( !PermFeatures[i]->decrement_value( Inst.FV[i],
 					      Inst.TV ) ){
 	FatalError( "Unable to Hide an Instance!" );
 	result = false;
       }
     }
-    if ( result )
+    if ( result ){
       Targets->decrement_value( Inst.TV );
+      refresh_arrays( Inst );
+    }
     return result;
   }
 
@@ -63,15 +85,16 @@ namespace Timbl {
     InstanceBase->AddInstance( Inst );
     MBL_init = do_sloppy_loo; // must be only true if you are REALY sure
     for ( size_t i=0; i < effective_feats && result; ++i ){
-      PermFeatures[i]->clear_matrix();
       if ( !PermFeatures[i]->increment_value( Inst.FV[i],
 					      Inst.TV ) ){
 	FatalError( "Unable to UnHide this Instance!" );
 	result = false;
       }
     }
-    if ( result )
+    if ( result ){
       Targets->increment_value( Inst.TV );
+      refresh_arrays( Inst );
+    }
     return result;
   }
 
@@ -220,6 +243,7 @@ namespace Timbl {
 	    }
 	    bool excl = false;
 	    effective_feats = 0;
+	    sparse_fresh = false;
 	    size_t i = 0;
 	    string::size_type pos = 0; // skip <
 	    while ( info_ok && pos != string::npos &&
@@ -27,12 +27,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <cfloat>
 #include <cctype>
 #include <ctime>
 #include <cstdio>
+#include <stdexcept>
 
 #include "ticcutils/StringOps.h"
 #include "ticcutils/TreeHash.h"
@@ -59,23 +63,124 @@ namespace Timbl {
   { }
 
   IBtree::~IBtree(){
+    // the nodes are owned by an IBtree_pool, so link and next are not ours
     delete TDistribution;
-    delete link;
-    delete next;
+  }
+
+  const size_t first_block = 16;
+  const size_t max_block = 64*1024;
+
+  IBtree_pool::~IBtree_pool(){
+    for ( const auto& b : blocks ){
+      for ( size_t i=0; i < b.used; ++i ){
+	b.nodes[i].~IBtree();
+      }
+      ::operator delete( b.nodes );
+    }
+  }
+
+  IBtree *IBtree_pool::alloc( FeatureValue *fv ){
+    if ( free_nodes ){
+      IBtree *result = free_nodes;
+      free_nodes = result->next;
+      if ( !free_nodes )
+	last_free = 0;
+      result->FValue = fv;
+      result->next = 0;
+      return result;
+    }
+    if ( blocks.empty() || blocks.back().used == blocks.back().size ){
+      block b;
+      b.size = blocks.empty() ? first_block
+	: min( 2*blocks.back().size, max_block );
+      b.nodes = static_cast<IBtree *>( ::operator new( b.size*sizeof(IBtree) ) );
+      b.used = 0;
+      blocks.push_back( b );
+    }
+    block& b = blocks.back();
+    return new ( &b.nodes[b.used++] ) IBtree( fv );
+  }
+
+  void IBtree_pool::release( IBtree *node ){
+    // only the node itself, not its link or next
+    delete node->TDistribution;
+    node->TDistribution = 0;
+    node->FValue = 0;
+    node->TValue = 0;
+    node->link = 0;
+    node->next = free_nodes;
+    if ( !free_nodes )
+      last_free = node;
+    free_nodes = node;
+  }
+
+  void IBtree_pool::adopt( IBtree_pool& other ){
+    // take over the nodes of other. We keep allocating from our last block
+    blocks.insert( blocks.empty() ? blocks.end() : blocks.end() - 1,
+		   other.blocks.begin(), other.blocks.end() );
+    other.blocks.clear();
+    if ( other.free_nodes ){
+      other.last_free->next = free_nodes;
+      if ( !free_nodes )
+	last_free = other.last_free;
+      free_nodes = other.free_nodes;
+      other.free_nodes = 0;
+      other.last_free = 0;
+    }
+  }
+
+  // sibling lists longer than this get a sorted index
+  const size_t index_threshold = 16;
+
+  IBtree *IBtree::add_indexed( FeatureValue *FV,
+			       IBtree **tree,
+			       unsigned long& cnt,
+			       IBtree_pool& pool,
+			       vector<IBtree *>& sibs ){
+    // like add_feat_val, using binary search on the sorted siblings
+    if ( sibs.empty() ){
+      for ( IBtree *pnt = *tree; pnt; pnt = pnt->next ){
+	sibs.push_back( pnt );
+      }
+    }
+    size_t index = FV->Index();
+    auto it = lower_bound( sibs.begin(), sibs.end(), index,
+			   []( const IBtree *n, size_t i ){
+			     return n->FValue->Index() < i; } );
+    if ( it != sibs.end() && (*it)->FValue == FV ){
+      return *it;
+    }
+    IBtree *result = pool.alloc( FV );
+    ++cnt;
+    if ( it == sibs.begin() ){
+      result->next = *tree;
+      *tree = result;
+    }
+    else {
+      result->next = (*(it-1))->next;
+      (*(it-1))->next = result;
+    }
+    sibs.insert( it, result );
+    return result;
   }
 
 #ifdef IBSTATS
   inline IBtree *IBtree::add_feat_val( FeatureValue *FV,
 				       unsigned int &mm,
 				       IBtree **tree,
-				       unsigned long& cnt ){
+				       unsigned long& cnt,
+				       IBtree_pool& pool,
+				       SI_map& index ){
 #else
   inline IBtree *IBtree::add_feat_val( FeatureValue *FV,
 				       IBtree **tree,
-				       unsigned long& cnt ){
+				       unsigned long& cnt,
+				       IBtree_pool& pool,
+				       SI_map& index ){
 #endif
     // Add a Featurevalue to the IB.
     IBtree **pnt = tree;
+    size_t steps = 0;
     while ( *pnt ){
       if ( (*pnt)->FValue == FV ){
 	// already there, so bail out.
@@ -85,19 +190,27 @@ namespace Timbl {
 #ifdef IBSTATS
 	++mm;
 #endif
+	if ( ++steps == index_threshold ){
+	  // a long list, continue with its index
+	  return add_indexed( FV, tree, cnt, pool, index[tree] );
+	}
 	pnt = &((*pnt)->next);
       }
       else {
 	// need to add a new node before the current one
+	auto it = index.find( tree );
+	if ( it != index.end() ){
+	  return add_indexed( FV, tree, cnt, pool, it->second );
+	}
 	IBtree *tmp = *pnt;
-	*pnt = new IBtree( FV );
+	*pnt = pool.alloc( FV );
 	++cnt;
 	(*pnt)->next = tmp;
 	return *pnt;
       }
     }
-    // add at the end.
-    *pnt = new IBtree( FV );
+    // add at the end. A list this short has no index
+    *pnt = pool.alloc( FV );
     ++cnt;
     return *pnt;
   }
@@ -270,12 +383,6 @@ namespace Timbl {
     PersistentDistributions = temp_persist;
   }
 
-  xmlNode *to_node( const FeatureValue *fv ){
-    xmlNode *result = TiCC::XmlNewNode( "feature" );
-    TiCC::XmlAddContent( result, fv->Name() );
-    return result;
-  }
-
   xmlNode *to_node( const TargetValue *tv ){
     xmlNode *result = TiCC::XmlNewNode( "target" );
     TiCC::XmlAddContent( result, tv->Name() );
@@ -298,31 +405,90 @@ namespace Timbl {
     return cnt;
   }
 
-  xmlNode *to_xml( IBtree *pnt ) {
-    xmlNode *nodes = TiCC::XmlNewNode( "nodes" );
+  // the tree is written the way libxml2 formats a document: 2 spaces of
+  // indentation per level, but never more than 60, and text escaped
+  // like libxml2 does for element content
+  static void xml_indent( ostream& os, size_t level ){
+    static const string spaces( 60, ' ' );
+    os.write( spaces.data(), 2*min( level, (size_t)30 ) );
+  }
+
+  static void xml_text( ostream& os, size_t level,
+			const char *tag, const string& text ){
+    xml_indent( os, level );
+    if ( text.empty() ){
+      os << "<" << tag << "/>\n";
+      return;
+    }
+    os << "<" << tag << ">";
+    for ( const auto& c : text ){
+      switch ( c ){
+      case '<':
+	os << "&lt;";
+	break;
+      case '>':
+	os << "&gt;";
+	break;
+      case '&':
+	os << "&amp;";
+	break;
+      case '\r':
+	os << "&#13;";
+	break;
+      default:
+	os << c;
+      }
+    }
+    os << "</" << tag << ">\n";
+  }
+
+  void write_xml( ostream& os, const IBtree *pnt, size_t level ) {
+    // depth first, so only the current path is in memory
+    xml_indent( os, level );
     int cnt = count_next( pnt );
-    TiCC::XmlSetAttribute( nodes, "nodecount", TiCC::toString( cnt ) );
+    if ( cnt == 0 ){
+      os << "<nodes nodecount=\"0\"/>\n";
+      return;
+    }
+    os << "<nodes nodecount=\"" << cnt << "\">\n";
     while ( pnt ){
-      xmlNode *node = TiCC::XmlNewChild( nodes, "node" );
-      if ( pnt->FValue )
-	xmlAddChild( node, to_node( pnt->FValue ) );
-      if ( pnt->TValue )
-	xmlAddChild( node, to_node( pnt->TValue ) );
+      const ValueDistribution *vd = 0;
+      bool sub = false;
       if ( pnt->link ){
 	if ( pnt->link->FValue )
-	  xmlAddChild( node, to_xml(pnt->link) );
-	else if ( pnt->link->TDistribution )
-	  xmlAddChild( node, to_node( pnt->link->TDistribution ) );
+	  sub = true;
+	else
+	  vd = pnt->link->TDistribution;
+      }
+      else
+	vd = pnt->TDistribution;
+      xml_indent( os, level+1 );
+      if ( !pnt->FValue && !pnt->TValue && !sub && !vd ){
+	os << "<node/>\n";
+      }
+      else {
+	os << "<node>\n";
+	if ( pnt->FValue )
+	  xml_text( os, level+2, "feature", pnt->FValue->Name() );
+	if ( pnt->TValue )
+	  xml_text( os, level+2, "target", pnt->TValue->Name() );
+	if ( sub )
+	  write_xml( os, pnt->link, level+2 );
+	else if ( vd )
+	  xml_text( os, level+2, "distribution", vd->DistToString() );
+	xml_indent( os, level+1 );
+	os << "</node>\n";
       }
-      else if ( pnt->TDistribution )
-	xmlAddChild( node, to_node( pnt->TDistribution ) );
       pnt = pnt->next;
     }
-    return nodes;
+    xml_indent( os, level );
+    os << "</nodes>\n";
   }
 
   void InstanceBase_base::toXML( ostream &os )  {
     // save an IBtree for later use.
+    // libxml2 only formats the small top of the document, the tree
+    // itself is written while walking it
     TiCC::XmlDoc doc( "root" );
     xmlNode *root = doc.getRoot();
     xmlAddChild( root,
@@ -331,18 +497,11 @@ namespace Timbl {
     xmlAddChild( root, to_node( TopTarget( dummy ) ) );
     if ( PersistentDistributions )
       xmlAddChild( root, to_node( TopDistribution ) );
-    IBtree *pnt = InstBase;
-    xmlNode *tree = to_xml( pnt );
-    xmlAddChild( root, tree );
-    os << doc << endl;
-  }
-
-  string toString( const vector<FeatureValue*>& vec ){
-    string result;
-    for ( auto const& fv : vec ){
-      result += " " + fv->Name();
-    }
-    return result;
+    string top = doc.toString();
+    string::size_type pos = top.rfind( "</root>" );
+    os << top.substr( 0, pos );
+    write_xml( os, InstBase, 1 );
+    os << top.substr( pos ) << endl;
   }
 
   void InstanceBase_base::printStatsTree( ostream &os,
@@ -352,20 +511,27 @@ namespace Timbl {
     }
     else {
       os << "statistics from level " << startLevel << " upwards" << endl;
-      unsigned int level = startLevel;
-      while ( level < Depth ){
-	IBtree *branch = InstBase;
-	while ( branch ){
-	  unsigned int l = level;
-	  IBtree *pnt = branch;
-	  vector<FeatureValue*> pad;
-	  while ( pnt && l-- > 0 ){
-	    pad.push_back( pnt->FValue );
-	    pnt = pnt->link;
-	  }
-	  if ( pnt ){
-	    os << level << " [" << toString(pad) << " " << pnt->FValue << " ] "
-	       << pnt->TDistribution << " < ";
+      // every branch is reported along its first nodes, so we collect
+      // those paths once, and write them level by level
+      vector<vector<const IBtree *>> paths;
+      for ( const IBtree *branch = InstBase; branch; branch = branch->next ){
+	vector<const IBtree *> path;
+	for ( const IBtree *pnt = branch;
+	      pnt && path.size() < Depth;
+	      pnt = pnt->link ){
+	  path.push_back( pnt );
+	}
+	paths.push_back( path );
+      }
+      for ( unsigned int level = startLevel; level < Depth; ++level ){
+	for ( const auto& path : paths ){
+	  if ( level < path.size() ){
+	    os << level << " [";
+	    for ( unsigned int l = 0; l < level; ++l ){
+	      os << " " << path[l]->FValue;
+	    }
+	    const IBtree *pnt = path[level];
+	    os << " " << pnt->FValue << " ] " << pnt->TDistribution << " < ";
 	    pnt = pnt->link;
 	    while ( pnt ){
 	      os << pnt->FValue;
@@ -373,11 +539,9 @@ namespace Timbl {
 	      if ( pnt )
 		os << " ";
 	    }
-	    os << " >" << endl;
+	    os << " >\n";
 	  }
-	  branch = branch->next;
 	}
-	++level;
       }
     }
   }
@@ -436,7 +600,7 @@ namespace Timbl {
       is >> delim;    // skip the opening `[` or separating ','
       *pnt = read_local( is, Feats, Targ, level );
       if ( !(*pnt) ){
-	delete result;
+	// the nodes read so far stay in the pool
 	return NULL;
       }
       pnt = &((*pnt)->next);
@@ -458,7 +622,6 @@ namespace Timbl {
       is >> delim;    // skip the opening `[` or separating ','
       *pnt = read_local_hashed( is, Feats, Targ, level );
       if ( !(*pnt) ){
-	delete result;
 	return NULL;
       }
       pnt = &((*pnt)->next);
@@ -474,7 +637,7 @@ namespace Timbl {
 					 int level ){
     if ( !is )
       return NULL;
-    IBtree *result = new IBtree();
+    IBtree *result = pool->alloc();
     ++ibCount;
     string buf;
     char delim;
@@ -483,7 +646,6 @@ namespace Timbl {
     is >> delim;
     if ( !is || delim != '(' ){
       Error( "missing `(` in Instance Base file" );
-      delete result;
       return NULL;
     }
     is >> ws >> buf;
@@ -497,7 +659,6 @@ namespace Timbl {
       catch ( const string& what ){
 	Warning( what );
 	Error( "problems reading a distribution from InstanceBase file" );
-	delete result;
 	return 0;
       }
       // also we have to update the targetinformation of the featurevalue
@@ -508,12 +669,11 @@ namespace Timbl {
     if ( look_ahead(is) == '[' ){
       result->link = read_list( is, Feats, Targ, level+1 );
       if ( !(result->link) ){
-	delete result;
 	return 0;
       }
     }
     else if ( look_ahead(is) == ')' && result->TDistribution ){
-      result->link = new IBtree();
+      result->link = pool->alloc();
       ++ibCount;
       result->link->TValue = result->TValue;
       if ( PersistentDistributions )
@@ -527,7 +687,6 @@ namespace Timbl {
     is >> delim;
     if ( delim != ')' ){
       Error( "missing `)` in Instance Base file" );
-      delete result;
       return NULL;
     }
     return result;
@@ -539,7 +698,7 @@ namespace Timbl {
 						int level ){
     if ( !is )
       return NULL;
-    IBtree *result = new IBtree();
+    IBtree *result = pool->alloc();
     ++ibCount;
     char delim;
     int index;
@@ -548,7 +707,6 @@ namespace Timbl {
     is >> delim;
     if ( !is || delim != '(' ){
       Error( "missing `(` in Instance Base file" );
-      delete result;
       return NULL;
     }
     is >> index;
@@ -566,14 +724,12 @@ namespace Timbl {
       catch ( const string& what ){
 	Warning( what );
 	Error( "problems reading a hashed distribution from InstanceBase file" );
-	delete result;
 	return 0;
       }
     }
     if ( look_ahead(is) == '[' ){
       result->link = read_list_hashed( is, Feats, Targ, level+1 );
       if ( !(result->link) ){
-	delete result;
 	return NULL;
       }
     }
@@ -581,7 +737,7 @@ namespace Timbl {
       //
       // make a dummy node for the targetdistributions just read
       //
-      result->link = new IBtree();
+      result->link = pool->alloc();
       ++ibCount;
       result->link->TValue = result->TValue;
       if ( PersistentDistributions )
@@ -595,12 +751,383 @@ namespace Timbl {
     is >> delim;
     if ( delim != ')' ){
       Error( "missing `)` in Instance Base file" );
-      delete result;
       return NULL;
     }
     return result;
   }
 
+  class tree_text: public streambuf {
+    // (a part of) an InstanceBase file in memory
+  public:
+    tree_text( const char *b, const char *e ){
+      setg( const_cast<char *>( b ), const_cast<char *>( b ),
+	    const_cast<char *>( e ) );
+    };
+    const char *pos() const { return gptr(); };
+    const char *end() const { return egptr(); };
+    void skip_to( const char *p ){
+      setg( eback(), const_cast<char *>( p ), egptr() );
+    };
+  };
+
+  static void read_text( istream& is, vector<char>& text ){
+    const size_t chunk = 1024*1024;
+    size_t len = 0;
+    while ( is ){
+      text.resize( len + chunk );
+      is.read( &text[len], chunk );
+      len += is.gcount();
+    }
+    text.resize( len );
+  }
+
+  // the scanner below follows the syntax of an InstanceBase file the way
+  // read_list() and read_local() read it, without storing anything.
+  // It returns 0 on anything unexpected.
+  static inline const char *skip_space( const char *p, const char *e ){
+    while ( p < e && isspace( (unsigned char)*p ) )
+      ++p;
+    return p;
+  }
+
+  static inline const char *skip_word( const char *p, const char *e ){
+    p = skip_space( p, e );
+    while ( p < e && !isspace( (unsigned char)*p ) )
+      ++p;
+    return p;
+  }
+
+  static inline const char *skip_number( const char *p, const char *e ){
+    p = skip_space( p, e );
+    while ( p < e && ( isdigit( (unsigned char)*p ) || *p == '.'
+		       || *p == '-' || *p == '+' || *p == 'e' || *p == 'E' ) )
+      ++p;
+    return p;
+  }
+
+  static const char *skip_distribution( const char *p, const char *e,
+					bool hashed ){
+    ++p; // the `{`
+    while ( true ){
+      p = hashed ? skip_number( p, e ) : skip_word( p, e );
+      p = skip_space( skip_number( p, e ), e );
+      if ( p < e && isdigit( (unsigned char)*p ) ){
+	// a weight
+	p = skip_space( skip_number( p, e ), e );
+      }
+      if ( p == e )
+	return 0;
+      else if ( *p == '}' )
+	return p+1;
+      else if ( *p != ',' )
+	return 0;
+      ++p;
+    }
+  }
+
+  static const char *skip_list( const char *, const char *, bool,
+				vector<pair<const char *, const char *>> * );
+
+  static const char *skip_local( const char *p, const char *e,
+				 bool hashed ){
+    p = skip_space( hashed ? skip_number( p, e ) : skip_word( p, e ), e );
+    if ( p == e || *p != '(' )
+      return 0;
+    p = skip_space( hashed ? skip_number( p+1, e ) : skip_word( p+1, e ), e );
+    if ( p < e && *p == '{' ){
+      p = skip_distribution( p, e, hashed );
+      if ( !p )
+	return 0;
+      p = skip_space( p, e );
+    }
+    if ( p < e && *p == '[' ){
+      p = skip_list( p, e, hashed, 0 );
+      if ( !p )
+	return 0;
+      p = skip_space( p, e );
+    }
+    if ( p == e || *p != ')' )
+      return 0;
+    return p+1;
+  }
+
+  static const char *skip_list( const char *p, const char *e, bool hashed,
+				vector<pair<const char *,
+				const char *>> *branches ){
+    // when branches is given, the byte range of every element is stored
+    ++p; // the `[`
+    while ( true ){
+      p = skip_space( p, e );
+      const char *start = p;
+      p = skip_local( p, e, hashed );
+      if ( !p )
+	return 0;
+      if ( branches )
+	branches->push_back( make_pair( start, p ) );
+      p = skip_space( p, e );
+      if ( p == e || *p != ',' )
+	break;
+      ++p;
+    }
+    if ( p == e || *p != ']' )
+      return 0;
+    return p+1;
+  }
+
+  class IBtree_reader {
+    // reads one branch of an InstanceBase file into a tree of its own.
+    // The Features are left alone: the values are collected, and only
+    // added to the Features by add_values(), in the order the sequential
+    // reader would add them, with the same frequencies.
+  public:
+    IBtree_reader( size_t d, Target *t, bool h, bool p ):
+      tree( 0 ), nodes( 0 ), tails( 0 ),
+      depth( d ), Targ( t ), hashed( h ), persist( p ),
+      str_ids( d ), index_ids( d ) {};
+    ~IBtree_reader(){
+      for ( const auto& v : values ){
+	delete v.dist;
+      }
+    };
+    bool read( const char *, const char * );
+    void add_values( vector<Feature *>& );
+    void assign_values();
+    IBtree *tree;
+    IBtree_pool pool;
+    unsigned long int nodes;
+    unsigned long int tails;
+  private:
+    IBtree_reader( const IBtree_reader& );
+    IBtree_reader& operator=( const IBtree_reader& );
+    struct value {
+      size_t level;
+      string str;
+      size_t index;
+      unsigned long int count;   // the number of nodes with this value
+      unsigned long int after;   // those after the last distribution
+      ValueDistribution *dist;   // the merged distributions
+    };
+    IBtree *read_list( istream&, size_t );
+    IBtree *read_local( istream&, size_t );
+    size_t value_id( size_t, const string&, size_t );
+    size_t depth;
+    Target *Targ;
+    bool hashed;
+    bool persist;
+    vector<unordered_map<string, size_t>> str_ids;
+    vector<unordered_map<size_t, size_t>> index_ids;
+    vector<value> values;
+    vector<pair<IBtree *, size_t>> fixups;
+    vector<FeatureValue *> resolved;
+  };
+
+  size_t IBtree_reader::value_id( size_t level,
+				  const string& str,
+				  size_t index ){
+    size_t id = values.size();
+    if ( hashed ){
+      auto it = index_ids[level].insert( make_pair( index, id ) );
+      if ( !it.second )
+	return it.first->second;
+    }
+    else {
+      auto it = str_ids[level].insert( make_pair( str, id ) );
+      if ( !it.second )
+	return it.first->second;
+    }
+    value v;
+    v.level = level;
+    v.str = str;
+    v.index = index;
+    v.count = 0;
+    v.after = 0;
+    v.dist = 0;
+    values.push_back( v );
+    return id;
+  }
+
+  IBtree *IBtree_reader::read_list( istream& is, size_t level ){
+    IBtree *result = 0;
+    IBtree **pnt = &result;
+    bool goon = true;
+    char delim;
+    while ( is && goon ) {
+      is >> delim;    // skip the opening `[` or separating ','
+      *pnt = read_local( is, level );
+      if ( !(*pnt) )
+	return 0;
+      pnt = &((*pnt)->next);
+      goon = ( look_ahead(is) == ',' );
+    }
+    is >> delim;    // skip closing `]`
+    return result;
+  }
+
+  IBtree *IBtree_reader::read_local( istream& is, size_t level ){
+    if ( !is || level >= depth )
+      return 0;
+    IBtree *result = pool.alloc();
+    ++nodes;
+    string buf;
+    int index = 0;
+    if ( hashed )
+      is >> index;
+    else
+      is >> ws >> buf;
+    size_t id = value_id( level, buf, index );
+    fixups.push_back( make_pair( result, id ) );
+    char delim;
+    is >> delim;
+    if ( !is || delim != '(' )
+      return 0;
+    if ( hashed ){
+      is >> index;
+      result->TValue = Targ->ReverseLookup( index );
+    }
+    else {
+      is >> ws >> buf;
+      result->TValue = Targ->Lookup( buf );
+    }
+    ++values[id].count;
+    ++values[id].after;
+    if ( look_ahead(is) == '{' ){
+      try {
+	if ( hashed )
+	  result->TDistribution
+	    = ValueDistribution::read_distribution_hashed( is, Targ, false );
+	else
+	  result->TDistribution
+	    = ValueDistribution::read_distribution( is, Targ, false );
+      }
+      catch ( const string& ){
+	return 0;
+      }
+      if ( !hashed ){
+	// see read_local(): the value gets the frequencies of this
+	// distribution
+	if ( !result->TDistribution )
+	  return 0;
+	value& v = values[id];
+	if ( !v.dist )
+	  v.dist = new ValueDistribution();
+	v.dist->Merge( *(result->TDistribution) );
+	v.after = 0;
+      }
+    }
+    if ( look_ahead(is) == '[' ){
+      result->link = read_list( is, level+1 );
+      if ( !(result->link) )
+	return 0;
+    }
+    else if ( look_ahead(is) == ')' && result->TDistribution ){
+      result->link = pool.alloc();
+      ++nodes;
+      result->link->TValue = result->TValue;
+      if ( persist )
+	result->link->TDistribution = result->TDistribution->to_VD_Copy();
+      else {
+	result->link->TDistribution = result->TDistribution;
+	result->TDistribution = 0;
+      }
+      ++tails;
+    }
+    is >> delim;
+    if ( delim != ')' )
+      return 0;
+    return result;
+  }
+
+  bool IBtree_reader::read( const char *b, const char *e ){
+    tree_text text( b, e );
+    istream is( &text );
+    tree = read_local( is, 0 );
+    return tree && look_ahead( is ) == -1;
+  }
+
+  void IBtree_reader::add_values( vector<Feature *>& Feats ){
+    resolved.resize( values.size() );
+    for ( size_t i=0; i < values.size(); ++i ){
+      const value& v = values[i];
+      FeatureValue *fv;
+      if ( hashed )
+	fv = Feats[v.level]->add_value( v.index, NULL, v.count );
+      else
+	fv = Feats[v.level]->add_value( v.str, NULL, v.count );
+      if ( v.dist ){
+	fv->ReconstructDistribution( *v.dist );
+	fv->IncValFreq( v.after );
+      }
+      resolved[i] = fv;
+    }
+  }
+
+  void IBtree_reader::assign_values(){
+    for ( const auto& f : fixups ){
+      f.first->FValue = resolved[f.second];
+    }
+  }
+
+  IBtree *InstanceBase_base::read_top( istream& is,
+				       vector<Feature *>& Feats,
+				       Target *Targ,
+				       bool hashed ){
+    // read the toplevel list of the tree. When the file is in memory,
+    // (see read_IB()) its branches are read in parallel.
+    // On any problem we fall back to the sequential reader, which
+    // also gives the proper error messages
+    tree_text *text = dynamic_cast<tree_text *>( is.rdbuf() );
+    vector<pair<const char *, const char *>> branches;
+    const char *stop = 0;
+    if ( text && read_threads > 1 && look_ahead( is ) == '[' ){
+      stop = skip_list( text->pos(), text->end(), hashed, &branches );
+    }
+    if ( !stop || branches.size() < 2 ){
+      if ( hashed )
+	return read_list_hashed( is, Feats, Targ, 0 );
+      else
+	return read_list( is, Feats, Targ, 0 );
+    }
+    vector<IBtree_reader *> readers( branches.size(), 0 );
+    bool ok = true;
+#pragma omp parallel for num_threads( read_threads ) schedule( dynamic )
+    for ( int i=0; i < (int)branches.size(); ++i ){
+      IBtree_reader *reader = new IBtree_reader( Depth, Targ, hashed,
+						 PersistentDistributions );
+      if ( !reader->read( branches[i].first, branches[i].second ) ){
+#pragma omp atomic write
+	ok = false;
+      }
+      readers[i] = reader;
+    }
+    if ( !ok ){
+      for ( const auto& r : readers ){
+	delete r;
+      }
+      if ( hashed )
+	return read_list_hashed( is, Feats, Targ, 0 );
+      else
+	return read_list( is, Feats, Targ, 0 );
+    }
+    for ( const auto& r : readers ){
+      r->add_values( Feats );
+    }
+#pragma omp parallel for num_threads( read_threads ) schedule( dynamic )
+    for ( int i=0; i < (int)readers.size(); ++i ){
+      readers[i]->assign_values();
+    }
+    IBtree *result = readers[0]->tree;
+    for ( size_t i=0; i < readers.size(); ++i ){
+      if ( i+1 < readers.size() )
+	readers[i]->tree->next = readers[i+1]->tree;
+      pool->adopt( readers[i]->pool );
+      ibCount += readers[i]->nodes;
+      NumOfTails += readers[i]->tails;
+      delete readers[i];
+    }
+    text->skip_to( stop );
+    return result;
+  }
+
   bool InstanceBase_base::ReadIB( istream &is,
 				  vector<Feature *>& Feats, Target *Targs,
 				  int expected_version ){
@@ -643,6 +1170,15 @@ namespace Timbl {
   bool InstanceBase_base::read_IB( istream &is,
 				   vector<Feature *>& Feats, Target *Targs,
 				   int expected_version ){
+    if ( read_threads > 1 && !dynamic_cast<tree_text *>( is.rdbuf() ) ){
+      // read the rest of the file in memory, so the branches of the
+      // tree can be parsed in parallel
+      vector<char> data;
+      read_text( is, data );
+      tree_text text( data.data(), data.data() + data.size() );
+      istream ts( &text );
+      return read_IB( ts, Feats, Targs, expected_version );
+    }
     string buf;
     NumOfTails = 0;
     DefAss = true;  // always for a restored tree
@@ -674,7 +1210,7 @@ namespace Timbl {
 	Error( "problems reading Top Distribution from Instance Base file" );
       else {
 	if ( look_ahead( is ) == '[' ){
-	  InstBase = read_list( is, Feats, Targs, 0 );
+	  InstBase = read_top( is, Feats, Targs, false );
 	}
 	if ( InstBase ){
 	  is >> ws >> buf;
@@ -761,6 +1297,13 @@ namespace Timbl {
 				   Hash::StringHash *cats,
 				   Hash::StringHash *feats,
 				   int expected_version ){
+    if ( read_threads > 1 && !dynamic_cast<tree_text *>( is.rdbuf() ) ){
+      vector<char> data;
+      read_text( is, data );
+      tree_text text( data.data(), data.data() + data.size() );
+      istream ts( &text );
+      return read_IB( ts, Feats, Targs, cats, feats, expected_version );
+    }
     char delim;
     NumOfTails = 0;
     DefAss = true;  // always for a restored tree
@@ -795,7 +1338,7 @@ namespace Timbl {
 	Error( "problems reading Top Distribution from Instance Base file" );
       }
       if ( look_ahead( is ) == '[' ){
-	InstBase = read_list_hashed( is, Feats, Targs, 0 );
+	InstBase = read_top( is, Feats, Targs, true );
       }
       if ( InstBase ){
 	is >> delim;
@@ -910,7 +1453,8 @@ namespace Timbl {
   }
 
   inline IBtree *IBtree::make_unique( const TargetValue *Top,
-				      unsigned long& cnt ){
+				      unsigned long& cnt,
+				      IBtree_pool& pool ){
     // remove branches with the same target as the Top, except when they
     // still have a subbranch, which means that they are an exception.
     IBtree **tmp, *dead, *result;
@@ -920,9 +1464,8 @@ namespace Timbl {
       if ( (*tmp)->TValue == Top && (*tmp)->link == NULL ){
 	dead = *tmp;
 	*tmp = (*tmp)->next;
-	dead->next=NULL;
 	--cnt;
-	delete dead;
+	pool.release( dead );
       }
       else
 	tmp = &((*tmp)->next);
@@ -932,17 +1475,40 @@ namespace Timbl {
 
   inline IBtree *IBtree::Reduce( const TargetValue *Top,
 				 unsigned long& cnt,
-				 long depth ){
+				 long depth,
+				 IBtree_pool& pool ){
     // recursively cut default nodes, (with make unique,) starting at the
     // leaves of the Tree and moving back to the top.
     IBtree *pnt = this;
     while ( pnt ){
       if ( pnt->link != NULL )
-	pnt->link = pnt->link->Reduce( pnt->TValue, cnt, depth-1 );
+	pnt->link = pnt->link->Reduce( pnt->TValue, cnt, depth-1, pool );
       pnt = pnt->next;
     }
     if ( depth <= 0 )
-      return make_unique( Top, cnt );
+      return make_unique( Top, cnt, pool );
+    else
+      return this;
+  }
+
+  IBtree *IBtree::reduce_upper( const TargetValue *Top,
+				unsigned long& cnt,
+				long depth,
+				IBtree_pool& pool,
+				size_t levels ){
+    // like Reduce(), for the upper levels only. The lists below those
+    // are reduced already
+    IBtree *pnt = this;
+    if ( levels > 0 ){
+      while ( pnt ){
+	if ( pnt->link != NULL )
+	  pnt->link = pnt->link->reduce_upper( pnt->TValue, cnt, depth-1,
+					       pool, levels-1 );
+	pnt = pnt->next;
+      }
+    }
+    if ( depth <= 0 )
+      return make_unique( Top, cnt, pool );
     else
       return this;
   }
@@ -975,6 +1541,513 @@ namespace Timbl {
     return NULL;
   }
 
+  size_t FV_vec_hash::operator()( const vector<FeatureValue*>& v ) const {
+    size_t result = 0;
+    for ( const auto& fv : v ){
+      result ^= fv->Index() + 0x9e3779b9 + (result << 6) + (result >> 2);
+    }
+    return result;
+  }
+
+  void InstanceBase_base::BuildExactIndex(){
+    // create the exact match index, and register the leaves already present
+    if ( !exact_index ){
+      exact_index = new EM_map();
+      if ( InstBase ){
+	fill_exact_index( InstBase, 0 );
+      }
+    }
+  }
+
+  void InstanceBase_base::fill_exact_index( IBtree *pnt, size_t level ){
+    // em_key holds the path from the top upto level
+    while ( pnt ){
+      if ( pnt->link == NULL ){
+	if ( level == Depth )
+	  (*exact_index)[em_key] = pnt;
+      }
+      else {
+	em_key[level] = pnt->FValue;
+	fill_exact_index( pnt->link, level+1 );
+      }
+      pnt = pnt->next;
+    }
+  }
+
+  IBtree *InstanceBase_base::exact_leaf( const Instance& Inst ) const {
+    for ( size_t i=0; i < Depth; ++i ){
+      em_key[i] = Inst.FV[i];
+    }
+    EM_map::const_iterator it = exact_index->find( em_key );
+    if ( it != exact_index->end() )
+      return it->second;
+    else
+      return NULL;
+  }
+
+  IG_compiled::IG_compiled( const IBtree *top, size_t depth, bool keep ){
+    tables.resize( depth );
+    nodes.resize( depth );
+    // the sibling lists to handle on the current level, with the id of
+    // their parent on the level above. The top list has a virtual parent 0
+    vector<pair<size_t,const IBtree *>> heads( 1, make_pair( 0, top ) );
+    for ( size_t l=0; l < depth && !heads.empty(); ++l ){
+      vector<pair<size_t,const IBtree *>> next_heads;
+      vector<cell> entries;
+      for ( const auto& h : heads ){
+	for ( const IBtree *pnt = h.second; pnt; pnt = pnt->next ){
+	  if ( !pnt->FValue )
+	    continue;
+	  node nd;
+	  nd.target = pnt->TValue;
+	  nd.dist = keep?pnt->TDistribution:0;
+	  nd.more = pnt->link && pnt->link->FValue;
+	  cell c;
+	  c.parent = h.first;
+	  c.value = pnt->FValue->Index();
+	  c.child = nodes[l].size();
+	  if ( nd.more )
+	    next_heads.push_back( make_pair( c.child, pnt->link ) );
+	  nodes[l].push_back( nd );
+	  entries.push_back( c );
+	}
+      }
+      size_t size = 2;
+      while ( size < 2*entries.size() )
+	size *= 2;
+      cell empty;
+      empty.parent = 0;
+      empty.value = 0; // known values never have index 0
+      empty.child = 0;
+      tables[l].assign( size, empty );
+      const size_t mask = size-1;
+      for ( const auto& c : entries ){
+	size_t i = hash( c.parent, c.value ) & mask;
+	while ( tables[l][i].value != 0 )
+	  i = (i+1) & mask;
+	tables[l][i] = c;
+      }
+      heads.swap( next_heads );
+    }
+  }
+
+  inline const IG_compiled::node *IG_compiled::find( size_t level,
+						     size_t& id,
+						     const FeatureValue *fv ) const {
+    const vector<cell>& tab = tables[level];
+    if ( !fv || fv->isUnknown() || tab.empty() )
+      return 0;
+    const size_t v = fv->Index();
+    const size_t mask = tab.size()-1;
+    for ( size_t i = hash( id, v ) & mask;
+	  tab[i].value != 0;
+	  i = (i+1) & mask ){
+      if ( tab[i].value == v && tab[i].parent == id ){
+	id = tab[i].child;
+	return &nodes[level][id];
+      }
+    }
+    return 0;
+  }
+
+  size_t IG_compiled::nodeCount() const {
+    size_t result = 0;
+    for ( const auto& n : nodes )
+      result += n.size();
+    return result;
+  }
+
+  size_t IG_compiled::byteSize() const {
+    size_t result = 0;
+    for ( size_t l=0; l < nodes.size(); ++l ){
+      result += nodes[l].size() * sizeof(node) + tables[l].size() * sizeof(cell);
+    }
+    return result;
+  }
+
+  const IG_compiled *InstanceBase_base::Compile(){
+    if ( !compiled && InstBase ){
+      compiled = new IG_compiled( InstBase, Depth, PersistentDistributions );
+    }
+    return compiled;
+  }
+
+  void InstanceBase_base::Uncompile(){
+    delete compiled;
+    compiled = 0;
+  }
+
+  bool IB_sparse::numValue( const FeatureValue *fv, double& val ) const {
+    val = 0.0;
+    if ( !fv || fv->Name() == dflt )
+      return false;
+    if ( !TiCC::stringTo<double>( fv->Name(), val ) ){
+      val = 0.0;
+      return false;
+    }
+    return val != 0.0;
+  }
+
+  IB_sparse::IB_sparse( const IBtree *top,
+			size_t depth,
+			const vector<Feature *>& feats,
+			const string& zero ):
+    dflt( zero )
+  {
+    postings.resize( depth );
+    weights.resize( depth );
+    zeros.resize( depth );
+    for ( size_t l=0; l < depth; ++l ){
+      weights[l] = feats[l]->Weight();
+      zeros[l] = feats[l]->Lookup( zero );
+    }
+    if ( !top || depth == 0 )
+      return;
+    // walk the tree depth first, without recursion: cur[l] is the node
+    // we are visiting on level l, path[l] its numeric value
+    unordered_map<const FeatureValue *,double> values;
+    vector<const IBtree *> cur( depth, 0 );
+    vector<double> path( depth, 0.0 );
+    size_t level = 0;
+    cur[0] = top;
+    while ( true ){
+      const IBtree *pnt = cur[level];
+      if ( !pnt ){
+	if ( level == 0 )
+	  break;
+	--level;
+	cur[level] = cur[level]->next;
+	continue;
+      }
+      double val = 0.0;
+      if ( !isZero( level, pnt->FValue ) ){
+	auto it = values.find( pnt->FValue );
+	if ( it == values.end() ){
+	  numValue( pnt->FValue, val );
+	  values[pnt->FValue] = val;
+	}
+	else
+	  val = it->second;
+      }
+      path[level] = val;
+      if ( level+1 < depth ){
+	cur[++level] = pnt->link;
+	continue;
+      }
+      const IBtree *leaf = pnt->link;
+      if ( leaf && leaf->TDistribution &&
+	   !leaf->TDistribution->ZeroDist() ){
+	size_t id = dists.size();
+	double norm = 0.0;
+	for ( size_t l=0; l < depth; ++l ){
+	  if ( path[l] != 0.0 ){
+	    norm += ( path[l] * path[l] ) * weights[l];
+	    postings[l].push_back( { id, path[l] } );
+	  }
+	}
+	dists.push_back( leaf->TDistribution );
+	norms.push_back( norm );
+      }
+      cur[level] = pnt->next;
+    }
+  }
+
+  const IB_sparse *InstanceBase_base::IndexSparse( const vector<Feature *>& feats,
+						   const string& dflt ){
+    DropSparseIndex();
+    if ( InstBase ){
+      sparse_index = new IB_sparse( InstBase, Depth, feats, dflt );
+    }
+    return sparse_index;
+  }
+
+  void InstanceBase_base::DropSparseIndex(){
+    delete sparse_index;
+    sparse_index = 0;
+  }
+
+  IB_columns::IB_columns( const IBtree *top, size_t depth ){
+    values.resize( depth );
+    ids.resize( depth );
+    if ( !top || depth == 0 )
+      return;
+    // walk the tree depth first, without recursion: cur[l] is the node
+    // we are visiting on level l, path[l] the id of its value
+    vector<unordered_map<const FeatureValue *,uint32_t>> lookup( depth );
+    vector<const IBtree *> cur( depth, 0 );
+    vector<uint32_t> path( depth, 0 );
+    size_t level = 0;
+    cur[0] = top;
+    while ( true ){
+      const IBtree *pnt = cur[level];
+      if ( !pnt ){
+	if ( level == 0 )
+	  break;
+	--level;
+	cur[level] = cur[level]->next;
+	continue;
+      }
+      auto it = lookup[level].insert( make_pair( pnt->FValue,
+						 values[level].size() ) );
+      if ( it.second )
+	values[level].push_back( pnt->FValue );
+      path[level] = it.first->second;
+      if ( level+1 < depth ){
+	cur[++level] = pnt->link;
+	continue;
+      }
+      const IBtree *leaf = pnt->link;
+      if ( leaf && leaf->TDistribution ){
+	for ( size_t l=0; l < depth; ++l ){
+	  ids[l].push_back( path[l] );
+	}
+	dists.push_back( leaf->TDistribution );
+      }
+      cur[level] = pnt->next;
+    }
+  }
+
+  const IB_columns *InstanceBase_base::BuildColumns(){
+    if ( !columns && InstBase ){
+      columns = new IB_columns( InstBase, Depth );
+    }
+    return columns;
+  }
+
+  void InstanceBase_base::DropColumns(){
+    delete columns;
+    columns = 0;
+    spread_level = 0;
+  }
+
+  size_t InstanceBase_base::SpreadLevel(){
+    //
+    // the number of levels after which the tree has a node for at least
+    // 90% of its leaves: below those, the paths of most instances aren't
+    // shared anymore, and a search visits about every node there
+    //
+    if ( spread_level == 0 && InstBase ){
+      vector<unsigned int> terminals;
+      vector<unsigned int> nonTerminals;
+      summarizeNodes( terminals, nonTerminals );
+      double leaves = terminals[Depth-1] + nonTerminals[Depth-1];
+      spread_level = Depth;
+      for ( size_t l=0; l < Depth; ++l ){
+	if ( terminals[l] + nonTerminals[l] >= 0.9 * leaves ){
+	  spread_level = l+1;
+	  break;
+	}
+      }
+    }
+    return spread_level;
+  }
+
+  IB_weights::IB_weights( const IBtree *top ):
+    least( DBL_MAX )
+  {
+    if ( top ){
+      gather( top );
+    }
+  }
+
+  double IB_weights::gather( const IBtree *list ){
+    // the largest weight below the nodes in list, which are all stored
+    double result = -DBL_MAX;
+    for ( const IBtree *pnt = list; pnt; pnt = pnt->next ){
+      double most = -DBL_MAX;
+      if ( pnt->link ){
+	most = gather( pnt->link );
+	nodes[pnt] = most;
+      }
+      else if ( pnt->TDistribution ){
+	for ( const auto& it : *pnt->TDistribution ){
+	  double w = it.second->Weight();
+	  most = max( most, w );
+	  least = min( least, w );
+	}
+      }
+      result = max( result, most );
+    }
+    return result;
+  }
+
+  double IB_weights::most( const IBtree *node ) const {
+    auto it = nodes.find( node );
+    if ( it == nodes.end() )
+      return DBL_MAX;
+    return it->second;
+  }
+
+  const IB_weights *InstanceBase_base::BuildWeights(){
+    if ( !weights && InstBase ){
+      weights = new IB_weights( InstBase );
+    }
+    return weights;
+  }
+
+  void InstanceBase_base::DropWeights(){
+    delete weights;
+    weights = 0;
+  }
+
+  double InstanceBase_base::PathWeight( size_t level ) const {
+    // the largest weight below the node of the current search path
+    // at this level
+    return weights->most( InstPath[level] );
+  }
+
+  IB_bounds::IB_bounds( const IBtree *top, size_t levels, size_t dpth ):
+    n_levels( min( levels, dpth ) ),
+    depth( dpth ),
+    all_values( dpth ),
+    offsets( dpth+1, 0 )
+  {
+    // first all values per level, then the bitsets of the upper nodes
+    vector<const IBtree *> cur( 1, top );
+    for ( size_t l=0; l < depth; ++l ){
+      vector<const IBtree *> nxt;
+      for ( const auto& list : cur ){
+	for ( const IBtree *pnt = list; pnt; pnt = pnt->next ){
+	  all_values[l].push_back( pnt->FValue );
+	  if ( l+1 < depth )
+	    nxt.push_back( pnt->link );
+	}
+      }
+      sort( all_values[l].begin(), all_values[l].end() );
+      all_values[l].erase( unique( all_values[l].begin(), all_values[l].end() ),
+			   all_values[l].end() );
+      offsets[l+1] = offsets[l] + ( all_values[l].size() + 63 ) / 64;
+      cur.swap( nxt );
+    }
+    if ( top ){
+      vector<uint64_t> dummy( offsets[depth] );
+      gather( top, 0, dummy );
+    }
+  }
+
+  size_t IB_bounds::valueId( size_t level, const FeatureValue *fv ) const {
+    // the position of fv in the values of level, or the number of values
+    // when it isn't there
+    const vector<FeatureValue *>& vals = all_values[level];
+    auto it = lower_bound( vals.begin(), vals.end(), fv );
+    if ( it != vals.end() && *it == fv )
+      return it - vals.begin();
+    return vals.size();
+  }
+
+  void IB_bounds::gather( const IBtree *list,
+			  size_t level,
+			  vector<uint64_t>& found ){
+    // set the bits of the values in list, and below it, in found (which
+    // has the layout of all levels). The nodes on the upper levels get
+    // bitsets of their own
+    for ( const IBtree *pnt = list; pnt; pnt = pnt->next ){
+      size_t id = valueId( level, pnt->FValue );
+      found[offsets[level]+id/64] |= uint64_t(1) << (id%64);
+      if ( level+1 == depth )
+	continue;
+      if ( level < n_levels ){
+	vector<uint64_t> own( offsets[depth] );
+	gather( pnt->link, level+1, own );
+	for ( size_t w=offsets[level+1]; w < offsets[depth]; ++w ){
+	  found[w] |= own[w];
+	}
+	nodes[pnt] = bits.size();
+	bits.insert( bits.end(), own.begin()+offsets[level+1], own.end() );
+      }
+      else {
+	gather( pnt->link, level+1, found );
+      }
+    }
+  }
+
+  const uint64_t *IB_bounds::below( const IBtree *node ) const {
+    // the bitsets of the levels under node
+    auto it = nodes.find( node );
+    if ( it == nodes.end() )
+      return 0;
+    return &bits[it->second];
+  }
+
+  void IB_path_bounds::init( const InstanceBase_base *base,
+			     const vector<FeatureValue *>& inst,
+			     const vector<double>& near ){
+    ib = base;
+    const IB_bounds *bounds = ib->Bounds();
+    ids.resize( near.size() );
+    for ( size_t l=0; l < ids.size(); ++l ){
+      ids[l] = bounds->valueId( l, inst[l] );
+    }
+    nearest = near;
+    size_t len = min( bounds->levels(), ids.size() );
+    paths.resize( len );
+    valid.assign( len, false );
+  }
+
+  const vector<double>& IB_path_bounds::least( size_t level ){
+    if ( !valid[level] ){
+      ib->SubtreeBound( level, ids, nearest, paths[level] );
+      valid[level] = true;
+    }
+    return paths[level];
+  }
+
+  const IB_bounds *InstanceBase_base::BuildBounds( size_t levels ){
+    if ( !bounds || bounds->levels() != min( levels, Depth ) ){
+      DropBounds();
+      if ( InstBase && levels > 0 ){
+	bounds = new IB_bounds( InstBase, levels, Depth );
+      }
+    }
+    return bounds;
+  }
+
+  void InstanceBase_base::DropBounds(){
+    delete bounds;
+    bounds = 0;
+  }
+
+  void InstanceBase_base::SubtreeBound( size_t level,
+					const vector<size_t>& ids,
+					const vector<double>& nearest,
+					vector<double>& least ) const {
+    //
+    // the least distances between a test instance and any instance below
+    // the node on level of the current search path, for the levels under
+    // it where the value of the test instance (with ids as in bounds)
+    // doesn't occur below the node: the distance to the nearest other
+    // value of that level, which nearest holds
+    //
+    least.clear();
+    const uint64_t *vals = 0;
+    if ( bounds && level < bounds->levels() )
+      vals = bounds->below( InstPath[level] );
+    if ( vals ){
+      for ( size_t l=level+1; l < Depth; ++l ){
+	if ( nearest[l] > 0.0
+	     && ( ids[l] == bounds->levelValues( l ).size()
+		  || !bounds->occurs( vals, level, l, ids[l] ) ) )
+	  least.push_back( nearest[l] );
+      }
+    }
+  }
+
+  const ValueDistribution *InstanceBase_base::ExactMatch( const Instance& Inst ) const {
+    if ( !exact_index )
+      return InstBase->exact_match( Inst );
+    // a single probe. The checks are the same as in IBtree::exact_match()
+    const IBtree *leaf = exact_leaf( Inst );
+    if ( leaf ){
+      for ( size_t i=0; i < Depth; ++i ){
+	if ( Inst.FV[i]->ValFreq() == 0 )
+	  return NULL;
+      }
+      if ( !leaf->TDistribution->ZeroDist() )
+	return leaf->TDistribution;
+    }
+    return NULL;
+  }
+
   InstanceBase_base::InstanceBase_base( size_t depth,
 					unsigned long int&cnt,
 					bool Rand,
@@ -990,9 +2063,23 @@ namespace Timbl {
     tiedTop(false),
     InstBase( 0 ),
     LastInstBasePos( 0 ),
+    pool( &own_nodes ),
     RestartSearch( new const IBtree *[depth] ),
     SkipSearch( new const IBtree *[depth] ),
     InstPath( new const IBtree *[depth] ),
+    exact_index( 0 ),
+    em_key( depth, 0 ),
+    compiled( 0 ),
+    sparse_index( 0 ),
+    columns( 0 ),
+    spread_level( 0 ),
+    weights( 0 ),
+    bounds( 0 ),
+    order_feats( 0 ),
+    order_limit( 1 ),
+    read_threads( 1 ),
+    prune_threads( 1 ),
+    node_visits( 0 ),
     ibCount( cnt ),
     Depth( depth ),
     NumOfTails( 0 )
@@ -1008,34 +2095,16 @@ namespace Timbl {
     if ( RestartSearch ){
       delete [] RestartSearch;
     }
-    // the Instance can become very large, with even millions of 'next' pointers
-    // so recursive deletion will use a lot of stack
-    // therefore we choose to iterate the first level(s).
-    IBtree *pnt1 = InstBase;
-    while ( pnt1 ){
-      IBtree *toDel1 = pnt1;
-      pnt1 = pnt1->next;
-      toDel1->next = 0;
-      IBtree *pnt2 = toDel1->link;
-      toDel1->link = 0;
-      while ( pnt2 ){
-	IBtree *toDel2 = pnt2;
-	pnt2 = pnt2->next;
-	toDel2->next = 0;
-	IBtree *pnt3 = toDel2->link;
-	toDel2->link = 0;
-	while ( pnt3 ){
-	  IBtree *toDel3 = pnt3;
-	  pnt3 = pnt3->next;
-	  toDel3->next = 0;
-	  delete toDel3;
-	}
-	delete toDel2;
-      }
-      delete toDel1;
-    }
+    // our nodes are freed all at once with own_nodes, without walking the
+    // (possibly huge) tree
     delete TopDistribution;
     delete WTop;
+    delete exact_index;
+    delete compiled;
+    delete sparse_index;
+    delete columns;
+    delete weights;
+    delete bounds;
   }
 
   IB_InstanceBase *IB_InstanceBase::clone() const {
@@ -1049,6 +2118,11 @@ namespace Timbl {
     result->NumOfTails = NumOfTails; // only usefull for Server???
     result->InstBase = InstBase;
     result->LastInstBasePos = LastInstBasePos;
+    result->exact_index = exact_index;
+    result->sparse_index = sparse_index;
+    result->columns = columns;
+    result->weights = weights;
+    result->bounds = bounds;
     delete result->TopDistribution;
     result->TopDistribution = TopDistribution;
     return result;
@@ -1067,6 +2141,8 @@ namespace Timbl {
     result->NumOfTails = NumOfTails; // only usefull for Server???
     result->InstBase = InstBase;
     result->LastInstBasePos = LastInstBasePos;
+    result->exact_index = exact_index;
+    result->compiled = compiled;
     delete result->TopDistribution;
     result->TopDistribution = TopDistribution;
     return result;
@@ -1111,6 +2187,7 @@ namespace Timbl {
     result->NumOfTails = NumOfTails; // only usefull for Server???
     result->InstBase = InstBase;
     result->LastInstBasePos = LastInstBasePos;
+    result->exact_index = exact_index;
     delete result->TopDistribution;
     result->TopDistribution = TopDistribution;
     return result;
@@ -1128,6 +2205,7 @@ namespace Timbl {
     result->NumOfTails = NumOfTails; // only usefull for Server???
     result->InstBase = InstBase;
     result->LastInstBasePos = LastInstBasePos;
+    result->exact_index = exact_index;
     delete result->TopDistribution;
     result->TopDistribution = TopDistribution;
     return result;
@@ -1175,16 +2253,86 @@ namespace Timbl {
     return result;
   }
 
+  void InstanceBase_base::sharePool( InstanceBase_base *master ){
+    // allocate our nodes from the pool of master, which we will be merged
+    // into. Only possible while we are still empty
+    if ( InstBase ){
+      throw logic_error( "sharePool: the InstanceBase is not empty" );
+    }
+    pool = master->pool;
+  }
+
   void InstanceBase_base::CleanPartition( bool distToo ){
     InstBase = 0; // prevent deletion of InstBase in next step!
+    exact_index = 0; // the index is shared too
+    compiled = 0; // and so is the compiled tree
+    sparse_index = 0; // and the sparse index
+    columns = 0; // and the columns
+    weights = 0; // and the exemplar weights
+    bounds = 0; // and the subtree bounds
     if ( !distToo )
       TopDistribution = 0; // save TopDistribution for deletion
     delete this;
   }
 
+  size_t InstanceBase_base::split_level( bool fresh,
+					 vector<IBtree *>& units ) const {
+    // the first level with enough nodes to keep prune_threads busy, when
+    // handled one subtree at a time. units gets the nodes on it that have
+    // a subtree. When fresh, we only descend through nodes without a
+    // distribution, like assign_defaults() does.
+    // Returns 0 with no units for trees that are better handled at once
+    units.clear();
+    if ( prune_threads < 2 || !InstBase )
+      return 0;
+    size_t wanted = max( (size_t)64, 4*(size_t)prune_threads );
+    vector<IBtree *> cur;
+    for ( IBtree *pnt = InstBase; pnt; pnt = pnt->next ){
+      cur.push_back( pnt );
+    }
+    for ( size_t l=0; l+1 < Depth && !cur.empty(); ++l ){
+      if ( cur.size() >= wanted ){
+	for ( const auto& pnt : cur ){
+	  if ( pnt->link )
+	    units.push_back( pnt );
+	}
+	return l;
+      }
+      vector<IBtree *> nxt;
+      for ( const auto& node : cur ){
+	if ( fresh && node->TDistribution )
+	  continue;
+	for ( IBtree *pnt = node->link; pnt; pnt = pnt->next ){
+	  nxt.push_back( pnt );
+	}
+      }
+      cur.swap( nxt );
+    }
+    return 0;
+  }
+
   void InstanceBase_base::AssignDefaults(){
     if ( !DefaultsValid ){
       if ( !DefAss ){
+	vector<IBtree *> units;
+	size_t level = 0;
+	if ( !Random ){
+	  // picking a random target isn't thread safe
+	  level = split_level( true, units );
+	}
+#pragma omp parallel for num_threads( prune_threads ) schedule( dynamic ) if ( !units.empty() )
+	for ( int i=0; i < (int)units.size(); ++i ){
+	  // what assign_defaults() does for these nodes. The pass below
+	  // finds their distribution, so doesn't descend any further
+	  IBtree *pnt = units[i];
+	  if ( !pnt->TDistribution ){
+	    pnt->link->assign_defaults( Random, PersistentDistributions,
+					Depth-level-1 );
+	    pnt->TDistribution
+	      = pnt->link->sum_distributions( Depth-level > 1
+					      && PersistentDistributions );
+	  }
+	}
 	InstBase->assign_defaults( Random,
 				   PersistentDistributions,
 				   Depth );
@@ -1217,9 +2365,37 @@ namespace Timbl {
   }
 
   void IG_InstanceBase::Prune( const TargetValue *top, long depth ){
+    Uncompile();
+    DropSparseIndex();
+    DropColumns();
+    DropWeights();
+    DropBounds();
     AssignDefaults( );
     if ( !Pruned ) {
-      InstBase = InstBase->Reduce( top, ibCount, depth );
+      sibling_index.clear();
+      vector<IBtree *> units;
+      size_t level = split_level( false, units );
+      if ( units.empty() ){
+	InstBase = InstBase->Reduce( top, ibCount, depth, *pool );
+      }
+      else {
+	// the subtrees below level on their own, releasing the nodes to a
+	// pool per subtree
+	vector<IBtree_pool> pools( units.size() );
+	unsigned long int before = ibCount;
+	vector<unsigned long int> counts( units.size(), before );
+#pragma omp parallel for num_threads( prune_threads ) schedule( dynamic )
+	for ( int i=0; i < (int)units.size(); ++i ){
+	  IBtree *pnt = units[i];
+	  pnt->link = pnt->link->Reduce( pnt->TValue, counts[i],
+					 depth-(long)level-1, pools[i] );
+	}
+	for ( size_t i=0; i < units.size(); ++i ){
+	  pool->adopt( pools[i] );
+	  ibCount -= before - counts[i];
+	}
+	InstBase = InstBase->reduce_upper( top, ibCount, depth, *pool, level );
+      }
       Pruned = true;
     }
   }
@@ -1236,11 +2412,16 @@ namespace Timbl {
     }
     bool dummy;
     InstBase->TValue = dist.BestTarget( dummy, Random );
-    InstBase = InstBase->Reduce( top, ibCount, 0 );
+    sibling_index.clear();
+    InstBase = InstBase->Reduce( top, ibCount, 0, *pool );
     Pruned = true;
   }
 
   bool InstanceBase_base::AddInstance( const Instance& Inst ){
+    Uncompile();
+    DropSparseIndex();
+    DropWeights();
+    unsigned long int nodes = ibCount;
     bool sw_conflict = false;
     // add one instance to the IB
     IBtree *hlp, **pnt = &InstBase;
@@ -1251,7 +2432,7 @@ namespace Timbl {
 #endif
     if ( !InstBase ){
       for ( unsigned int i = 0; i < Depth; ++i ){
-	*pnt = new IBtree( Inst.FV[i] );
+	*pnt = pool->alloc( Inst.FV[i] );
 	++ibCount;
 	pnt = &((*pnt)->link);
       }
@@ -1260,9 +2441,11 @@ namespace Timbl {
     else {
       for ( unsigned int i = 0; i < Depth; ++i ){
 #ifdef IBSTATS
-	hlp = (*pnt)->add_feat_val( Inst.FV[i], mismatch[i], pnt, ibCount );
+	hlp = IBtree::add_feat_val( Inst.FV[i], mismatch[i], pnt, ibCount,
+				    *pool, sibling_index );
 #else
-	hlp = (*pnt)->add_feat_val( Inst.FV[i], pnt, ibCount );
+	hlp = IBtree::add_feat_val( Inst.FV[i], pnt, ibCount, *pool,
+				    sibling_index );
 #endif
 	if ( i==0 && hlp->next == 0 )
 	  LastInstBasePos = hlp;
@@ -1270,13 +2453,19 @@ namespace Timbl {
       }
     }
     if ( *pnt == NULL ){
-      *pnt = new IBtree();
+      *pnt = pool->alloc();
       ++ibCount;
       if ( abs( Inst.ExemplarWeight() ) > Epsilon )
 	(*pnt)->TDistribution = new WValueDistribution();
       else
 	(*pnt)->TDistribution = new ValueDistribution;
       NumOfTails++;
+      if ( exact_index ){
+	for ( size_t i=0; i < Depth; ++i ){
+	  em_key[i] = Inst.FV[i];
+	}
+	(*exact_index)[em_key] = *pnt;
+      }
     }
     int occ = Inst.Occurrences();
     if ( abs( Inst.ExemplarWeight() ) > Epsilon ){
@@ -1288,16 +2477,32 @@ namespace Timbl {
     }
     TopDistribution->IncFreq(Inst.TV, occ );
     DefaultsValid = false;
+    if ( ibCount != nodes ){
+      // the columns and bounds only depend on the shape of the tree
+      DropColumns();
+      DropBounds();
+    }
     return !sw_conflict;
   }
 
   bool InstanceBase_base::MergeSub( InstanceBase_base *ib ){
+    DropSparseIndex();
+    DropColumns();
+    DropWeights();
+    DropBounds();
+    sibling_index.clear();
+    if ( ib->pool != pool ){
+      pool->adopt( *ib->pool );
+    }
     if ( ib->InstBase ){
       // we place the InstanceBase of ib in front of the current InstanceBase
       // the assumption is that both are sorted on ascending index, and that
       // the indices in ib are all smaller then those in the current IB
       if ( !InstBase ){
 	InstBase = ib->InstBase;
+	if ( exact_index ){
+	  fill_exact_index( InstBase, 0 );
+	}
       }
       else {
 	IBtree *ibPnt = ib->InstBase;
@@ -1306,6 +2511,9 @@ namespace Timbl {
 	  return false;
 	}
 	else {
+	  if ( exact_index ){
+	    fill_exact_index( ibPnt, 0 );
+	  }
 	  ib->LastInstBasePos->next = InstBase;
 	  InstBase = ibPnt;
 	}
@@ -1343,6 +2551,15 @@ namespace Timbl {
   }
 
   bool IG_InstanceBase::MergeSub( InstanceBase_base *ib ){
+    Uncompile();
+    DropSparseIndex();
+    DropColumns();
+    DropWeights();
+    DropBounds();
+    sibling_index.clear();
+    if ( ib->pool != pool ){
+      pool->adopt( *ib->pool );
+    }
     if ( ib->InstBase ){
       if ( !PersistentDistributions ){
 	ib->InstBase->cleanDistributions();
@@ -1366,16 +2583,15 @@ namespace Timbl {
 	    // snip the link and insert at our link
 	    IBtree *snip = ibPnt->link;
 	    ibPnt->link = 0;
-	    delete ibPnt->TDistribution;
-	    ibPnt->TDistribution = 0;
 	    --ib->ibCount;
-	    delete ibPnt;
+	    pool->release( ibPnt );
+	    // both lists are sorted, so we merge them in one pass
+	    IBtree **tmp = &(*pnt)->link;
 	    while ( snip ){
 	      if ( PersistentDistributions )
 		(*pnt)->TDistribution->Merge( *snip->TDistribution );
 	      else
 		delete snip->TDistribution;
-	      IBtree **tmp = &(*pnt)->link;
 	      while ( *tmp && (*tmp)->FValue->Index() < snip->FValue->Index() ){
 		tmp = &(*tmp)->next;
 	      }
@@ -1388,6 +2604,7 @@ namespace Timbl {
 		snip->next = *tmp;
 	      }
 	      *tmp = snip;
+	      tmp = &snip->next;
 	      snip = nxt;
 	    }
 	  }
@@ -1418,6 +2635,19 @@ namespace Timbl {
   }
 
   void InstanceBase_base::RemoveInstance( const Instance& Inst ){
+    Uncompile();
+    DropSparseIndex();
+    if ( exact_index ){
+      IBtree *leaf = exact_leaf( Inst );
+      if ( leaf ){
+	for ( int occ=0; occ < Inst.Occurrences(); ++occ ){
+	  leaf->TDistribution->DecFreq(Inst.TV);
+	  TopDistribution->DecFreq(Inst.TV);
+	}
+      }
+      DefaultsValid = false;
+      return;
+    }
     for ( int occ=0; occ < Inst.Occurrences(); ++occ ){
       // remove an instance from the IB
       int pos = 0;
@@ -1480,6 +2710,34 @@ namespace Timbl {
 
   //#define DEBUGTESTS
 
+  const IBtree *IB_InstanceBase::sort_siblings( size_t lev,
+						const IBtree *pnt ){
+    // order the siblings starting at pnt on their distance to the test
+    // value, so the closest ones are visited first
+    Feature *feat = (*order_feats)[offSet+lev];
+    FeatureValue *tv = (*testInst)[offSet+lev];
+    vector<pair<double,const IBtree *>>& sibs = siblings[lev];
+    sibs.clear();
+    sib_pos[lev] = 0;
+    if ( !pnt->next ){
+      // nothing to order
+      sibs.push_back( make_pair( 0.0, pnt ) );
+      return pnt;
+    }
+    while ( pnt ){
+      sibs.push_back( make_pair( feat->fvDistance( tv,
+						   pnt->FValue,
+						   order_limit ),
+				 pnt ) );
+      pnt = pnt->next;
+    }
+    stable_sort( sibs.begin(), sibs.end(),
+		 []( const pair<double,const IBtree *>& a,
+		     const pair<double,const IBtree *>& b ){
+		   return a.first < b.first; } );
+    return sibs[0].second;
+  }
+
   const ValueDistribution *IB_InstanceBase::InitGraphTest( vector<FeatureValue *>& Path,
 							   const vector<FeatureValue *> *inst,
 							   size_t off,
@@ -1492,8 +2750,32 @@ namespace Timbl {
 #ifdef DEBUGTESTS
     cerr << "initTest for " << *inst << endl;
 #endif
+    sorted.assign( Depth, false );
+    if ( order_feats ){
+      siblings.resize( Depth );
+      sib_pos.resize( Depth );
+      for ( size_t i = 0; i < Depth; ++i ){
+	bool dummy;
+	const Feature *feat = (*order_feats)[offSet+i];
+	sorted[i] = feat && feat->matrixPresent( dummy );
+      }
+    }
     pnt = InstBase;
     for ( unsigned int i = 0; i < Depth; ++i ){
+      ++node_visits;
+      if ( sorted[i] ){
+	pnt = sort_siblings( i, pnt );
+	RestartSearch[i] = NULL;
+	SkipSearch[i] = NULL;
+	InstPath[i] = pnt;
+	Path[i] = pnt->FValue;
+	pnt = pnt->link;
+	if ( pnt && pnt->link == NULL ){
+	  result = pnt->TDistribution;
+	  break;
+	}
+	continue;
+      }
       InstPath[i] = pnt;
       RestartSearch[i] = pnt;
       if ( i == 0 )
@@ -1544,7 +2826,11 @@ namespace Timbl {
     const ValueDistribution *result = NULL;
     bool goon = true;
     while ( !pnt && goon ){
-      if ( RestartSearch[pos] == NULL ) {
+      if ( sorted[pos] ){
+	if ( ++sib_pos[pos] < siblings[pos].size() )
+	  pnt = siblings[pos][sib_pos[pos]].second;
+      }
+      else if ( RestartSearch[pos] == NULL ) {
 	// No exact match here, so no real problems
 	pnt = InstPath[pos]->next;
 	//	cerr << "NO MATCH increment ";
@@ -1570,6 +2856,7 @@ namespace Timbl {
       }
     }
     if ( pnt && goon ) {
+      ++node_visits;
       InstPath[pos] = pnt;
       Path[pos] = pnt->FValue;
 #ifdef DEBUGTESTS
@@ -1577,6 +2864,16 @@ namespace Timbl {
 #endif
       pnt = pnt->link;
       for (  size_t j=pos+1; j < Depth; ++j ){
+	++node_visits;
+	if ( sorted[j] ){
+	  pnt = sort_siblings( j, pnt );
+	  RestartSearch[j] = NULL;
+	  SkipSearch[j] = NULL;
+	  InstPath[j] = pnt;
+	  Path[j] = pnt->FValue;
+	  pnt = pnt->link;
+	  continue;
+	}
 	const IBtree *tmp = pnt->search_node( (*testInst)[offSet+j] );
 	if ( tmp ){ // we found an exact match, so mark Restart position
 	  if ( pnt == tmp )
@@ -1632,9 +2929,30 @@ namespace Timbl {
     // distribution of the last matching position in the Tree, it's position
     // in the Instance Base and the default TargetValue
     result = NULL;
-    ValueDistribution *Dist = NULL;
-    int pos = 0;
+    const ValueDistribution *Dist = NULL;
+    size_t pos = 0;
     leaf = false;
+    if ( compiled ){
+      size_t id = 0;
+      while ( pos < Depth ){
+	const IG_compiled::node *nd = compiled->find( pos, id, Inst.FV[pos] );
+	if ( !nd )
+	  break;
+	result = nd->target;
+	Dist = nd->dist;
+	leaf = !nd->more;
+	++pos;
+	if ( leaf )
+	  break;
+      }
+      end_level = pos;
+      if ( end_level == 0 ){
+	if ( !WTop && TopDistribution )
+	  WTop = TopDistribution->to_WVD_Copy();
+	Dist = WTop;
+      }
+      return Dist;
+    }
     const IBtree *pnt = fast_search_node( Inst.FV[pos] );
     while ( pnt ){
       result = pnt->TValue;
@@ -60,11 +60,24 @@ namespace Timbl {
 	confusionInfo = 0;
 	if ( Verbosity(ADVANCED_STATS) )
 	  confusionInfo = new ConfusionMatrix( Targets->ValuesArray.size() );
-	if ( !is_copy ){
+	if ( !is_copy || is_synced ){
 	  InitWeights();
 	  if ( do_diversify )
 	    diverseWeights();
 	  srand( random_seed );
+	  clearCache();
+	  if ( !do_compile ){
+	    if ( InstanceBase )
+	      InstanceBase->Uncompile();
+	  }
+	  else if ( InstanceBase && !InstanceBase->Compiled() ){
+	    const IG_compiled *comp = InstanceBase->Compile();
+	    if ( comp && !Verbosity(SILENT) ){
+	      Info( "Compiled IGTree: " + TiCC::toString( comp->nodeCount() )
+		    + " nodes in " + TiCC::toString( comp->byteSize() )
+		    + " bytes" );
+	    }
+	  }
 	}
 	MBL_init = true;
       }
@@ -135,14 +148,14 @@ namespace Timbl {
 	  //	cerr << "MAJORITY CLASS = " << TopTarget << endl;
 	  // Open the file.
 	  //
-	  ifstream datafile( CurrentDataFile, ios::in);
+	  DataStream datafile( CurrentDataFile, ios::in);
+	  cacheScope use_cache( this, CurrentDataFile, datafile, true );
 	  //
 	  fileIndex::const_iterator fit = fmIndex.begin();
 	  while ( fit != fmIndex.end() ){
 	    set<streamsize>::const_iterator sit = fit->second.begin();
 	    while ( sit != fit->second.end() ){
-	      datafile.clear();
-	      datafile.seekg( *sit );
+	      seekLine( datafile, *sit );
 	      nextLine( datafile, Buffer );
 	      chopLine( Buffer );
 	      // Progress update.
@@ -156,6 +169,8 @@ namespace Timbl {
 						       (RandomSeed()>=0),
 						       false,
 						       true );
+		outInstanceBase->sharePool( InstanceBase );
+		outInstanceBase->PruneThreads( Clones() );
 	      }
 	      //		cerr << "add instance " << &CurrInst << endl;
 	      outInstanceBase->AddInstance( CurrInst );
@@ -198,7 +213,8 @@ namespace Timbl {
 	  //	cerr << "MAJORITY CLASS = " << TopTarget << endl;
 	  // Open the file.
 	  //
-	  ifstream datafile( CurrentDataFile, ios::in);
+	  DataStream datafile( CurrentDataFile, ios::in);
+	  cacheScope use_cache( this, CurrentDataFile, datafile, true );
 	  //
 	  fileDoubleIndex::const_iterator dit = fmIndex.begin();
 	  while ( dit != fmIndex.end() ){
@@ -215,12 +231,12 @@ namespace Timbl {
 						     (RandomSeed()>=0),
 						     false,
 						     true );
+	      TmpInstanceBase->sharePool( InstanceBase );
 	      fileIndex::const_iterator fit = dit->second.begin();
 	      while ( fit !=  dit->second.end() ) {
 		set<streamsize>::const_iterator sit = fit->second.begin();
 		while ( sit != fit->second.end() ){
-		  datafile.clear();
-		  datafile.seekg( *sit );
+		  seekLine( datafile, *sit );
 		  nextLine( datafile, Buffer );
 		  chopLine( Buffer );
 		  // Progress update.
@@ -234,6 +250,8 @@ namespace Timbl {
 							    (RandomSeed()>=0),
 							    false,
 							    true );
+		    PartInstanceBase->sharePool( InstanceBase );
+		    PartInstanceBase->PruneThreads( Clones() );
 		  }
 		  //		cerr << "add instance " << &CurrInst << endl;
 		  PartInstanceBase->AddInstance( CurrInst );
@@ -278,8 +296,7 @@ namespace Timbl {
 	      while ( fit != dit->second.end() ){
 		set<streamsize>::const_iterator sit = fit->second.begin();
 		while ( sit != fit->second.end() ){
-		  datafile.clear();
-		  datafile.seekg( *sit );
+		  seekLine( datafile, *sit );
 		  nextLine( datafile, Buffer );
 		  chopLine( Buffer );
 		  // Progress update.
@@ -287,12 +304,15 @@ namespace Timbl {
 		  if (( stats.dataLines() % Progress() ) == 0)
 		    time_stamp( "Learning:  ", stats.dataLines() );
 		  chopped_to_instance( TrainWords );
-		  if ( !outInstanceBase )
+		  if ( !outInstanceBase ){
 		    outInstanceBase = new IG_InstanceBase( EffectiveFeatures(),
 							   ibCount,
 							   (RandomSeed()>=0),
 							   false,
 							   true );
+		    outInstanceBase->sharePool( InstanceBase );
+		    outInstanceBase->PruneThreads( Clones() );
+		  }
 		  //	      cerr << "add instance " << &CurrInst << endl;
 		  outInstanceBase->AddInstance( CurrInst );
 		  ++sit;
@@ -336,8 +356,8 @@ namespace Timbl {
   }
 
 
-  bool IG_Experiment::checkLine( const string& line ){
-    if ( TimblExperiment::checkLine( line ) )
+  bool IG_Experiment::checkTestable( InputFormatType IF ){
+    if ( TimblExperiment::checkTestable( IF ) )
       return sanityCheck();
     else
       return false;
@@ -482,6 +502,7 @@ namespace Timbl {
 	  else
 	    PermFeatures[pos++] = Features[permutation[i]];
 	}
+	InstanceBase->ReadThreads( Clones() );
 	if ( Hashed )
 	  result = InstanceBase->ReadIB( is, PermFeatures,
 					 Targets,
@@ -32,6 +32,7 @@
 #include <algorithm> // for sort()
 #include <iomanip>
 #include <cassert>
+#include <cfloat>
 
 #include "ticcutils/StringOps.h"
 #include "ticcutils/TreeHash.h"
@@ -48,6 +49,75 @@ using namespace std;
 namespace Timbl {
   using namespace Common;
 
+  namespace Recycle {
+    // blocks upto 128 bytes are kept, in classes of 8 bytes
+    const size_t classes = 16;
+    const size_t max_blocks = 4096;
+
+    thread_local bool closed = false;
+
+    struct free_lists {
+      free_lists(){
+	for ( size_t c=0; c < classes; ++c ){
+	  head[c] = 0;
+	  count[c] = 0;
+	}
+      }
+      ~free_lists(){
+	// blocks returned after this are freed directly
+	closed = true;
+	for ( size_t c=0; c < classes; ++c ){
+	  while ( head[c] ){
+	    void *p = head[c];
+	    head[c] = *static_cast<void**>( p );
+	    ::operator delete( p );
+	  }
+	}
+      }
+      void *head[classes];
+      size_t count[classes];
+    };
+
+    static free_lists *local_lists(){
+      if ( closed )
+	return 0;
+      static thread_local free_lists lists;
+      return &lists;
+    }
+
+    void *get( size_t s ){
+      size_t c = (s+7)/8;
+      if ( c == 0 || c > classes )
+	return ::operator new( s );
+      --c;
+      free_lists *fl = local_lists();
+      if ( fl && fl->head[c] ){
+	void *p = fl->head[c];
+	fl->head[c] = *static_cast<void**>( p );
+	--fl->count[c];
+	return p;
+      }
+      return ::operator new( (c+1)*8 );
+    }
+
+    void put( void *p, size_t s ){
+      if ( !p )
+	return;
+      size_t c = (s+7)/8;
+      if ( c > 0 && c <= classes ){
+	--c;
+	free_lists *fl = local_lists();
+	if ( fl && fl->count[c] < max_blocks ){
+	  *static_cast<void**>( p ) = fl->head[c];
+	  fl->head[c] = p;
+	  ++fl->count[c];
+	  return;
+	}
+      }
+      ::operator delete( p );
+    }
+  }
+
   size_t Vfield::Index() { return value->Index(); }
 
   ostream& operator<<(ostream& os, const Vfield *vd ) {
@@ -604,9 +674,13 @@ namespace Timbl {
     BaseFeatTargClass(T),
     metric_matrix( 0 ),
     metric( 0 ),
+    own_metric( false ),
+    unshared( false ),
     ignore( false ),
     numeric( false ),
     vcpb_read( false ),
+    matrix_current( false ),
+    matrix_limit( 0 ),
     PrestoreStatus(ps_undef),
     Prestored_metric( UnknownMetric ),
     entropy( 0.0 ),
@@ -633,12 +707,23 @@ namespace Timbl {
   Feature& Feature::operator=( const Feature& in ){
     if ( this != &in ){
       metric_matrix = in.metric_matrix;
-      metric = in.metric;
+      if ( in.metric && !in.metric->isShareable() ){
+	// copies may run in other threads
+	metric = getMetricClass( in.metric->type() );
+	own_metric = true;
+      }
+      else {
+	metric = in.metric;
+	own_metric = false;
+      }
+      unshared = false;
       PrestoreStatus = in.PrestoreStatus;
       Prestored_metric = in.Prestored_metric;
       ignore = in.ignore;
       numeric = in.numeric;
       vcpb_read = in.vcpb_read;
+      matrix_current = in.matrix_current;
+      matrix_limit = in.matrix_limit;
       entropy = in.entropy;
       info_gain = in.info_gain;
       split_info = in.split_info;
@@ -658,30 +743,67 @@ namespace Timbl {
     return *this;
   }
 
+  void Feature::InitSparseArray( FeatureValue *FV ){
+    size_t freq = FV->ValFreq();
+    FV->ValueClassProb->Clear();
+    if ( freq > 0 ){
+      // Loop over all present classes.
+      //
+      ValueDistribution::dist_iterator It = FV->TargetDist.begin();
+      while ( It != FV->TargetDist.end() ){
+	FV->ValueClassProb->Assign( It->second->Index(),
+				    It->second->Freq()/(double)freq );
+	++It;
+      }
+    }
+  }
+
   void Feature::InitSparseArrays(){
-    if ( !is_copy ){
+    if ( !is_copy && !matrix_current ){
       // Loop over all values.
       //
       VCarrtype::const_iterator it = ValuesArray.begin();
       while ( it != ValuesArray.end() ){
-	FeatureValue *FV = (FeatureValue*)*it;
-	size_t freq = FV->ValFreq();
-	FV->ValueClassProb->Clear();
-	if ( freq > 0 ){
-	  // Loop over all present classes.
-	  //
-	  ValueDistribution::dist_iterator It = FV->TargetDist.begin();
-	  while ( It != FV->TargetDist.end() ){
-	    FV->ValueClassProb->Assign( It->second->Index(),
-					It->second->Freq()/(double)freq );
-	    ++It;
-	  }
-	}
+	InitSparseArray( (FeatureValue*)*it );
 	++it;
       }
     }
   }
 
+  bool Feature::refresh_value( FeatureValue *FV, size_t Dim,
+			       size_t clip, int limit ){
+    //
+    // FV's distribution changed by one instance. Update its probabilities
+    // and its row of the VD matrix, so we avoid a complete store_matrix().
+    // Returns false when that is impossible and a rebuild is needed.
+    //
+    if ( is_copy || !matrix_current || vcpb_read ||
+	 limit != matrix_limit ||
+	 !FV || FV->isUnknown() ||
+	 clip != matrix_clip_freq ){
+      return false;
+    }
+    if ( FV->ValueClassProb == NULL ){
+      FV->ValueClassProb = new SparseValueProbClass( Dim );
+    }
+    InitSparseArray( FV );
+    for ( const auto& other : ValuesArray ){
+      if ( other != FV ){
+	if ( FV->ValFreq() >= matrix_clip_freq &&
+	     other->ValFreq() >= matrix_clip_freq ){
+	  double dist = metric->distance( FV,
+					  reinterpret_cast<FeatureValue*>(other),
+					  limit );
+	  metric_matrix->Assign( FV, other, dist );
+	}
+	else {
+	  metric_matrix->Remove( FV, other );
+	}
+      }
+    }
+    return true;
+  }
+
   struct D_D {
     D_D(): dist(0), value(0.0) {};
     explicit D_D( FeatureValue *fv ): value(0.0) {
@@ -1011,6 +1133,12 @@ namespace Timbl {
 
   double Feature::fvDistance( FeatureValue *F, FeatureValue *G,
 			      size_t limit ) const {
+    return fvDistance( F, G, limit, DBL_MAX );
+  }
+
+  double Feature::fvDistance( FeatureValue *F, FeatureValue *G,
+			      size_t limit, double bound ) const {
+    // beyond bound, the result may be any value larger than bound
     double result = 0.0;
     if ( F != G ){
       bool dummy;
@@ -1023,7 +1151,7 @@ namespace Timbl {
 	result = metric->distance( F, G, limit, Max() - Min() );
       }
       else {
-	result = metric->distance( F, G, limit );
+	result = metric->bounded_distance( F, G, limit, bound );
       }
     }
     return result;
@@ -1367,14 +1495,35 @@ namespace Timbl {
   }
 
   Feature::~Feature(){
-    if ( !is_copy ){
+    if ( !is_copy || unshared ){
       if ( n_dot_j ) {
 	delete [] n_dot_j;
 	delete [] n_i_dot;
       }
-      delete_matrix();
       delete metric;
     }
+    else if ( own_metric ){
+      delete metric;
+    }
+    if ( !is_copy ){
+      delete_matrix();
+    }
+  }
+
+  void Feature::unshare(){
+    // a copy normally shares the metric and the chi-square arrays of
+    // its original. Take private ones, so this copy may select another
+    // metric and compute its own weights.
+    if ( is_copy && !unshared ){
+      if ( metric && !own_metric ){
+	metric = getMetricClass( metric->type() );
+      }
+      n_dot_j = 0;
+      n_i_dot = 0;
+      SaveSize = 0;
+      SaveNum = 0;
+      unshared = true;
+    }
   }
 
   bool Feature::matrixPresent( bool& isRead ) const {
@@ -1473,12 +1622,14 @@ namespace Timbl {
     }
     metric_matrix = 0;
     PrestoreStatus = ps_undef;
+    matrix_current = false;
   }
 
   bool Feature::setMetricType( const MetricType M ){
     if ( !metric || M != metric->type() ){
       delete metric;
       metric = getMetricClass(M);
+      matrix_current = false;
       return true;
     }
     else {
@@ -1492,8 +1643,10 @@ namespace Timbl {
     //
     // Store a complete distance matrix.
     //
-    if ( PrestoreStatus == ps_read )
+    if ( PrestoreStatus == ps_read ||
+	 ( matrix_current && limit == matrix_limit ) )
       return true;
+    matrix_current = false;
     if ( !metric_matrix )
       metric_matrix = new SparseSymetricMatrix<ValueClass*>();
     if ( PrestoreStatus != ps_failed && metric->isStorable( ) ) {
@@ -1522,6 +1675,8 @@ namespace Timbl {
     }
     if ( PrestoreStatus == ps_ok ){
       Prestored_metric = metric->type();
+      matrix_current = !vcpb_read;
+      matrix_limit = limit;
     }
     return true;
   }
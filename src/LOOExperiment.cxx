@@ -60,6 +60,7 @@ namespace Timbl {
 	  InitWeights();
 	  if ( do_diversify )
 	    diverseWeights();
+	  initSearch();
 	  srand( random_seed );
 	}
 	initTesters();
@@ -92,6 +93,7 @@ namespace Timbl {
       show_metric_info( os );
       show_weight_info( os );
       os << decay << endl;
+      show_search_info( os );
     }
   }
 
@@ -104,6 +106,7 @@ namespace Timbl {
 	FatalError( "the file '" + FileName + "' contains only 1 usable line. LOO impossible!" );
       }
       initExperiment();
+      cacheScope use_cache( this, testStreamName, testStream );
       stats.clear();
       delete confusionInfo;
       confusionInfo = 0;
@@ -34,6 +34,7 @@
 #include <typeinfo>
 
 #include <ctime>
+#include <cmath>
 #include <cassert>
 
 #include "ticcutils/StringOps.h"
@@ -50,6 +51,7 @@
 #include "timbl/Testers.h"
 #include "timbl/Metrics.h"
 #include "timbl/Choppers.h"
+#include "timbl/DataStream.h"
 
 #include "timbl/MBLClass.h"
 
@@ -89,6 +91,8 @@ namespace Timbl {
 					  &ib2_offset, 0, 1, 10000000 ) )
       && Options.Add( new BoolOption( "KEEP_DISTRIBUTIONS",
 				      &keep_distributions, false ) )
+      && Options.Add( new BoolOption( "EXACT_INDEX",
+				      &do_exact_index, false ) )
       && Options.Add( new BoolOption( "DO_SLOPPY_LOO",
 				      &do_sloppy_loo, false ) )
       && Options.Add( new SizeOption( "TARGET_POS",
@@ -102,6 +106,14 @@ namespace Timbl {
 				     &do_silly_testing, false ) )
 	&& Options.Add( new BoolOption( "DO_DIVERSIFY",
 					&do_diversify, false ) )
+	&& Options.Add( new BoolOption( "BEST_FIRST",
+					&do_best_first, false ) )
+	&& Options.Add( new BoolOption( "COMPILE_IGTREE",
+					&do_compile, false ) )
+	&& Options.Add( new SizeOption( "BOUND_LEVELS",
+					&bound_levels, 0, 0, MaxFeatures ) )
+	&& Options.Add( new IntegerOption( "LINEAR_SCAN",
+					   &linear_scan, -1, -1, 1 ) )
 	&& Options.Add( new DecayOption( "DECAY",
 					 &decay_flag, Zero ) )
 	&& Options.Add( new IntegerOption( "SEED",
@@ -209,9 +221,17 @@ namespace Timbl {
     do_sloppy_loo = false;
     do_silly_testing = false;
     do_diversify = false;
+    do_exact_index = false;
+    do_best_first = false;
+    do_compile = false;
     keep_distributions = false;
     UserOptions.resize(MaxFeatures+1);
     tester = 0;
+    sparse_fresh = false;
+    bound_levels = 0;
+    linear_scan = -1;
+    nearest_for = 0;
+    path_bounds = 0;
     //    cerr << "call fill table() in InitClass()" << endl;
     fill_table();
     decay = 0;
@@ -221,6 +241,8 @@ namespace Timbl {
 
   MBLClass::MBLClass( const string& name ){
     tableFilled = false;
+    dummies_used = 0;
+    sparse_fresh = false;
     exp_name = name;
   }
 
@@ -269,9 +291,17 @@ namespace Timbl {
       do_sloppy_loo      = m.do_sloppy_loo;
       do_silly_testing   = m.do_silly_testing;
       do_diversify       = m.do_diversify;
+      do_exact_index     = m.do_exact_index;
+      do_best_first      = m.do_best_first;
+      do_compile         = m.do_compile;
+      bound_levels       = m.bound_levels;
+      linear_scan        = m.linear_scan;
       permutation = m.permutation;
       tester = 0;
+      sparse_fresh = false;
       decay = 0;
+      nearest_for = 0;
+      path_bounds = 0;
       Features  = m.Features;
       PermFeatures = m.PermFeatures;
       for ( unsigned int i=0; i < Features.size(); ++i ){
@@ -285,7 +315,7 @@ namespace Timbl {
       err_count = 0;
       MBL_init = false;
       need_all_weights = false;
-      InstanceBase = m.InstanceBase->Copy();
+      InstanceBase = m.InstanceBase?m.InstanceBase->Copy():0;
       TargetStrings = m.TargetStrings;
       FeatureStrings = m.FeatureStrings;
       effective_feats = m.effective_feats;
@@ -302,7 +332,12 @@ namespace Timbl {
   }
 
   MBLClass::~MBLClass(){
+    release_dummies();
     CurrInst.clear();
+    for ( size_t i=0; i < dummy_values.size(); ++i ){
+      delete dummy_values[i];
+      delete dummy_names[i];
+    }
     if ( !is_copy ){
       delete InstanceBase;
       delete Targets;
@@ -322,6 +357,7 @@ namespace Timbl {
     }
     delete GlobalMetric;
     delete tester;
+    delete path_bounds;
     delete decay;
     delete ChopInput;
   }
@@ -444,6 +480,7 @@ namespace Timbl {
     vector<double> WR = W;
     size_t IgnoredFeatures = 0;
     permutation.resize(num_of_features);
+    sparse_fresh = false;
     for ( size_t j=0; j < num_of_features; ++j ){
       permutation[j] = j;
       if ( Features[j]->Ignore() ){
@@ -613,6 +650,8 @@ namespace Timbl {
 	Order[i] =  1.0 / feat->ValuesArray.size();
 	break;
       case GRoverFeature:
+      case SearchOrder:
+	// the search starts from the default IB1 ordering
 	Order[i] =  feat->GainRatio() / feat->ValuesArray.size();
 	break;
       case IGoverFeature:
@@ -639,7 +678,7 @@ namespace Timbl {
       ++i;
     }
     calculatePermutation( Order );
-    if ( !Verbosity(SILENT) )
+    if ( !Verbosity(SILENT) && TreeOrder != SearchOrder )
       writePermutation( *mylog );
     for ( size_t j=0; j < num_of_features; ++j ){
       if ( j < effective_feats )
@@ -856,22 +895,32 @@ namespace Timbl {
 
   bool MBLClass::allocate_arrays(){
     size_t Dim = Targets->ValuesArray.size();
-    for ( const auto& feat : Features ){
+    bool result = true;
+    int feats = Features.size();
+#pragma omp parallel for num_threads( Clones() ) schedule( dynamic )
+    for ( int i=0; i < feats; ++i ){
+      Feature *feat = Features[i];
       if ( !feat->Ignore() &&
 	   !feat->isNumerical() ) {
-	if ( !feat->AllocSparseArrays( Dim ) )
-	  return false;
+	if ( !feat->AllocSparseArrays( Dim ) ){
+#pragma omp atomic write
+	  result = false;
+	}
       }
     }
-    return true;
+    return result;
   }
 
   bool MBLClass::initProbabilityArrays( bool force ){
     bool result = true;
     if ( !is_copy ){
+      array_timer.start();
       result = allocate_arrays();
       if ( result ){
-	for ( const auto& feat : Features ){
+	int feats = Features.size();
+#pragma omp parallel for num_threads( Clones() ) schedule( dynamic )
+	for ( int i=0; i < feats; ++i ){
+	  Feature *feat = Features[i];
 	  if ( !feat->Ignore() &&
 	       !feat->isNumerical() ){
 	    feat->ClipFreq( (int)rint(clip_factor *
@@ -882,8 +931,9 @@ namespace Timbl {
 	      feat->InitSparseArrays();
 	    }
 	  }
-	} // j
+	} // i
       }
+      array_timer.stop();
     }
     return result;
   }
@@ -893,12 +943,16 @@ namespace Timbl {
   */
   void MBLClass::calculatePrestored(){
     if ( !is_copy ){
-      for ( size_t j = tribl_offset; j < effective_feats; ++j ) {
+      matrix_timer.start();
+      int last = effective_feats;
+#pragma omp parallel for num_threads( Clones() ) schedule( dynamic )
+      for ( int j = tribl_offset; j < last; ++j ) {
 	if ( !PermFeatures[j]->Ignore() &&
 	     PermFeatures[j]->isStorableMetric() ){
 	  PermFeatures[j]->store_matrix( mvd_threshold );
 	}
       }
+      matrix_timer.stop();
       if ( Verbosity(VD_MATRIX) ){
 	size_t pos = 0;
 	for ( auto const& feat : Features ){
@@ -920,8 +974,116 @@ namespace Timbl {
     }
   }
 
+  static const string DefaultBinString = "0";
+
+  bool MBLClass::sparse_input() const {
+    return ( input_format == Sparse || input_format == SparseBin )
+      && num_of_features == target_pos;
+  }
+
+  void MBLClass::sparse_to_instance( bool testing ){
+    // Sparse and Binary lines mostly consist of default values. CurrInst
+    // keeps those between lines, so only the fields on the line and the
+    // levels that still lack a default value need a Lookup
+    const string& dflt = ( input_format == SparseBin )?DefaultBinString:DefaultSparseString;
+    if ( !sparse_fresh ){
+      sparse_defaults.assign( num_of_features, 0 );
+      sparse_level.resize( num_of_features );
+      sparse_missing.clear();
+      for ( size_t m = 0; m < num_of_features; ++m ){
+	size_t j = permutation[m];
+	if ( m >= effective_feats ){
+	  sparse_level[j] = num_of_features;
+	  continue;
+	}
+	sparse_level[j] = m;
+	sparse_defaults[m] = Features[j]->Lookup( dflt );
+	CurrInst.FV[m] = sparse_defaults[m];
+	if ( !sparse_defaults[m] ){
+	  sparse_missing.push_back( m );
+	}
+      }
+      sparse_set.clear();
+      sparse_fresh = true;
+    }
+    for ( size_t i = 0; i < sparse_missing.size(); ){
+      // the default might be added later, so keep trying
+      size_t m = sparse_missing[i];
+      sparse_defaults[m] = Features[permutation[m]]->Lookup( dflt );
+      if ( sparse_defaults[m] ){
+	CurrInst.FV[m] = sparse_defaults[m];
+	sparse_missing[i] = sparse_missing.back();
+	sparse_missing.pop_back();
+	continue;
+      }
+      if ( testing ){
+	CurrInst.FV[m] = dummy_value( dflt );
+	sparse_set.push_back( m );
+      }
+      ++i;
+    }
+    for ( const auto& j : ChopInput->nonZero() ){
+      if ( j >= num_of_features || sparse_level[j] >= effective_feats )
+	continue;
+      size_t m = sparse_level[j];
+      const string& fld = ChopInput->getField(j);
+      CurrInst.FV[m] = Features[j]->Lookup( fld );
+      if ( !CurrInst.FV[m] && testing ){
+	CurrInst.FV[m] = dummy_value( fld );
+      }
+      sparse_set.push_back( m );
+    }
+  }
+
+  bool MBLClass::sparse_reset(){
+    // undo the previous sparse line in CurrInst, instead of a clear()
+    if ( !sparse_fresh ){
+      return false;
+    }
+    for ( const auto& m : sparse_set ){
+      CurrInst.FV[m] = sparse_defaults[m];
+    }
+    sparse_set.clear();
+    dummies_used = 0;
+    CurrInst.TV = 0;
+    CurrInst.ExemplarWeight( 0.0 );
+    CurrInst.Occurrences( 1 );
+    return true;
+  }
+
+  FeatureValue *MBLClass::dummy_value( const string& name ){
+    // a FeatureValue for a value unseen in training. They are only valid
+    // for the current instance, and are recycled for the next one
+    if ( dummies_used == dummy_values.size() ){
+      string *s = new string( name );
+      dummy_names.push_back( s );
+      dummy_values.push_back( new FeatureValue( *s ) );
+    }
+    else {
+      *dummy_names[dummies_used] = name;
+    }
+    return dummy_values[dummies_used++];
+  }
+
+  void MBLClass::release_dummies(){
+    if ( dummies_used > 0 ){
+      // only the dummies have an index of 0
+      for ( auto& fv : CurrInst.FV ){
+	if ( fv && fv->isUnknown() )
+	  fv = 0;
+      }
+      dummies_used = 0;
+    }
+  }
+
   const Instance *MBLClass::chopped_to_instance( PhaseValue phase ){
-    CurrInst.clear();
+    bool sparse = sparse_input()
+      && ( phase == TrainWords || phase == TestWords );
+    if ( !sparse || !sparse_reset() ){
+      release_dummies();
+      CurrInst.clear();
+      sparse_fresh = false;
+    }
     if ( num_of_features != target_pos ) {
       ChopInput->swapTarget( target_pos );
     }
@@ -949,10 +1111,15 @@ namespace Timbl {
     case TrainWords:
       // Lookup for TreeBuilding
       // First the Features
-      for ( size_t k = 0; k < effective_feats; ++k ){
-	size_t j = permutation[k];
-	CurrInst.FV[k] = Features[j]->Lookup( ChopInput->getField(j) );
-      } // k
+      if ( sparse_input() ){
+	sparse_to_instance( false );
+      }
+      else {
+	for ( size_t k = 0; k < effective_feats; ++k ){
+	  size_t j = permutation[k];
+	  CurrInst.FV[k] = Features[j]->Lookup( ChopInput->getField(j) );
+	} // k
+      }
       // and the Target
       CurrInst.TV = Targets->Lookup( ChopInput->getField( num_of_features ) );
       break;
@@ -972,16 +1139,20 @@ namespace Timbl {
     case TestWords:
       // Lookup for Testing
       // This might fail for unknown values, then we create a dummy value
-      for ( size_t m = 0; m < effective_feats; ++m ){
-	size_t j = permutation[m];
-	const string& fld =  ChopInput->getField(j);
-	CurrInst.FV[m] = Features[j]->Lookup( fld );
-	if ( !CurrInst.FV[m] ){
-	  // for "unknown" values have to add a dummy value
-	  CurrInst.FV[m] = new FeatureValue( fld );
-	}
-
-      } // i
+      if ( sparse_input() ){
+	sparse_to_instance( true );
+      }
+      else {
+	for ( size_t m = 0; m < effective_feats; ++m ){
+	  size_t j = permutation[m];
+	  const string& fld =  ChopInput->getField(j);
+	  CurrInst.FV[m] = Features[j]->Lookup( fld );
+	  if ( !CurrInst.FV[m] ){
+	    // for "unknown" values have to add a dummy value
+	    CurrInst.FV[m] = dummy_value( fld );
+	  }
+	} // i
+      }
       // the last string is the target
       CurrInst.TV = Targets->Lookup( ChopInput->getField(num_of_features) );
       break;
@@ -998,6 +1169,44 @@ namespace Timbl {
     return &CurrInst;
   }
 
+  const Instance *MBLClass::fields_to_instance( const vector<string>& fields ){
+    // like chopped_to_instance( TestWords ), for a test instance given as
+    // one value per feature, optionally followed by the target
+    release_dummies();
+    CurrInst.clear();
+    sparse_fresh = false;
+    for ( size_t m = 0; m < effective_feats; ++m ){
+      size_t j = permutation[m];
+      CurrInst.FV[m] = Features[j]->Lookup( fields[j] );
+      if ( !CurrInst.FV[m] ){
+	CurrInst.FV[m] = dummy_value( fields[j] );
+      }
+    }
+    if ( fields.size() > num_of_features ){
+      CurrInst.TV = Targets->Lookup( fields[num_of_features] );
+    }
+    return &CurrInst;
+  }
+
+  const Instance *MBLClass::values_to_instance( const vector<size_t>& ids ){
+    // like fields_to_instance(), for values encoded with their Index().
+    // Unknown values (id 0) get an empty dummy value
+    release_dummies();
+    CurrInst.clear();
+    sparse_fresh = false;
+    for ( size_t m = 0; m < effective_feats; ++m ){
+      size_t j = permutation[m];
+      const auto it = Features[j]->ValuesMap.find( ids[j] );
+      if ( it != Features[j]->ValuesMap.end() ){
+	CurrInst.FV[m] = reinterpret_cast<FeatureValue *>( it->second );
+      }
+      else {
+	CurrInst.FV[m] = dummy_value( "" );
+      }
+    }
+    return &CurrInst;
+  }
+
   bool empty_line( const string& Line, const InputFormatType IF ){
     // determine wether Line is empty or a commentline
     bool result = ( Line.empty() ||
@@ -1484,9 +1693,16 @@ namespace Timbl {
 	Warning( ostr2.str() );
       }
     }
-    if ( always || realy_first ){
-      for ( const auto& feat : Features ){
-	if ( Weighting != UserDefined_w ){
+    if ( ( always || realy_first ) &&
+	 Weighting != UserDefined_w ){
+      // the features are independent, so spread them over the clones
+      stat_timer.start();
+      string failure;
+      int feats = Features.size();
+#pragma omp parallel for num_threads( Clones() ) schedule( dynamic )
+      for ( int i=0; i < feats; ++i ){
+	Feature *feat = Features[i];
+	try {
 	  if ( CurrentWeighting() == SD_w )
 	    feat->StandardDeviationStatistics( );
 	  else if ( feat->isNumerical() ){
@@ -1497,6 +1713,14 @@ namespace Timbl {
 	    feat->Statistics( DBEntropy, Targets, need_all_weights );
 	  }
 	}
+	catch( const exception& e ){
+#pragma omp critical (stat_failure)
+	  failure = e.what();
+	}
+      }
+      stat_timer.stop();
+      if ( !failure.empty() ){
+	throw( logic_error( failure ) );
       }
     }
   }
@@ -1586,17 +1810,14 @@ namespace Timbl {
   string MBLClass::formatInstance( const vector<FeatureValue *>& OrgFV,
 				   vector<FeatureValue *>& RedFV,
 				   size_t OffSet,
-				   size_t Size ) const {
+				   size_t ) const {
     string result;
-    Instance inst( Size );
-    for ( size_t i=0; i< OffSet; ++i )
-      inst.FV[i] = OrgFV[i];
-    for ( size_t j=OffSet; j< Size; ++j )
-      inst.FV[j] = RedFV[j-OffSet];
-    size_t *InvPerm = new size_t[num_of_features];
+    inv_perm.resize( num_of_features );
     for ( size_t i=0; i< num_of_features; ++i )
-      InvPerm[permutation[i]] = i;
+      inv_perm[permutation[i]] = i;
     for ( size_t j=0; j< num_of_features; ++j ){
+      size_t pos = inv_perm[j];
+      const FeatureValue *fv = ( pos < OffSet )?OrgFV[pos]:RedFV[pos-OffSet];
       switch ( input_format ) {
       case C4_5:
 	// fall through
@@ -1604,38 +1825,37 @@ namespace Timbl {
 	if ( Features[j]->Ignore() )
 	  result += "-*-,";
 	else
-	  result += inst.FV[InvPerm[j]]->Name() + ",";
+	  result += fv->Name() + ",";
 	break;
       case Sparse:
-	if ( inst.FV[InvPerm[j]]->Name() != DefaultSparseString )
+	if ( fv->Name() != DefaultSparseString )
 	  result += string("(")  + TiCC::toString<size_t>(j+1) + ","
-	    + CodeToStr( inst.FV[InvPerm[j]]->Name() ) + ")";
+	    + CodeToStr( fv->Name() ) + ")";
 	break;
       case SparseBin:
-	if ( inst.FV[InvPerm[j]]->Name()[0] == '1' )
+	if ( fv->Name()[0] == '1' )
 	  result += TiCC::toString<size_t>( j+1 ) + ",";
 	break;
       case Columns:
 	if ( Features[j]->Ignore() )
 	  result += "-*- ";
 	else
-	  result += inst.FV[InvPerm[j]]->Name() + " ";
+	  result += fv->Name() + " ";
 	break;
       case Tabbed:
 	if ( Features[j]->Ignore() )
 	  result += "-*- ";
 	else
-	  result += inst.FV[InvPerm[j]]->Name() + "\t";
+	  result += fv->Name() + "\t";
 	break;
       default:
 	if ( Features[j]->Ignore() )
 	  result += string( F_length, '*' );
 	else
-	  result += inst.FV[InvPerm[j]]->Name();
+	  result += fv->Name();
 	break;
       }
     }
-    delete [] InvPerm;
     return result;
   }
 
@@ -1644,59 +1864,110 @@ namespace Timbl {
   }
 
 
+  double MBLClass::path_weight( const InstanceBase_base *IB, size_t level ){
+    // looked up only once per node on the search path
+    if ( path_weights[level] < 0.0 )
+      path_weights[level] = IB->PathWeight( level );
+    return path_weights[level];
+  }
+
   void MBLClass::test_instance_ex( const Instance& Inst,
 				   InstanceBase_base *IB,
 				   size_t ib_offset ){
-    vector<FeatureValue *> CurrentFV(num_of_features);
+    vector<FeatureValue *>& CurrentFV = query_fv;
+    CurrentFV.assign( num_of_features, 0 );
     size_t EffFeat = effective_feats - ib_offset;
     const ValueDistribution *best_distrib = IB->InitGraphTest( CurrentFV,
 							       &Inst.FV,
 							       ib_offset,
 							       effective_feats );
     tester->init( Inst, effective_feats, ib_offset );
-    ValueDistribution::dist_iterator lastpos;
-    Vfield *Bpnt = NULL;
-    if ( best_distrib ){
-      lastpos = best_distrib->begin();
-      if ( lastpos != best_distrib->end() )
-	Bpnt = lastpos->second;
-    }
+    // with only positive exemplar weights, a subtree is out of reach when
+    // the distance so far, divided by the largest weight below it, is
+    // beyond the k-th distance already
+    const IB_weights *weights = ( ib_offset == 0 ) ? IB->Weights() : 0;
+    if ( weights && !weights->positive() )
+      weights = 0;
+    if ( weights )
+      path_weights.assign( EffFeat, -1.0 );
+    double Threshold = DBL_MAX;
     size_t CurPos = 0;
-    while ( Bpnt ) {
-      // call test() with a maximum threshold, to prevent stepping out early
+    while ( best_distrib ) {
+      // without weights, call test() with a maximum threshold, to prevent
+      // stepping out early. Otherwise with the largest distance that any
+      // instance below CurPos might still do with, and a little room for
+      // rounding
+      double Limit = DBL_MAX;
+      double top = DBL_MAX;
+      if ( weights ){
+	if ( CurPos+1 == EffFeat ){
+	  // the leaves are right here
+	  top = 0.0;
+	  for ( const auto& it : *best_distrib ){
+	    top = max( top, it.second->Weight() );
+	  }
+	  path_weights[CurPos] = top;
+	}
+	else
+	  top = path_weight( IB, CurPos );
+	Limit = ( Threshold + Epsilon ) * ( top + Epsilon ) * ( 1.0 + 1.0e-9 );
+      }
       size_t EndPos  = tester->test( CurrentFV,
 				     CurPos,
-				     DBL_MAX );
-      if ( EndPos != EffFeat ){
-	throw( logic_error( "Exemplar testing: test should not stop before last feature" ) );
+				     Limit );
+      size_t pos = EndPos;
+      if ( weights ){
+	// the first level that is out of reach. The weight below CurPos
+	// bounds those below it, so mostly no lookups are needed
+	for ( pos = CurPos; pos < EndPos; ++pos ){
+	  double D = tester->getDistance(pos+1);
+	  if ( WeightFun( D, top ) > Threshold + Epsilon
+	       && WeightFun( D, path_weight( IB, pos ) ) > Threshold + Epsilon )
+	    break;
+	}
       }
-      ValueDistribution ResultDist;
-      ResultDist.SetFreq( Bpnt->Value(), Bpnt->Freq() );
-      string origI;
-      if ( Verbosity(NEAR_N) ){
-	origI = formatInstance( Inst.FV, CurrentFV,
-				ib_offset,
-				num_of_features );
-      }
-      double Distance = WeightFun( tester->getDistance(EndPos),
-				   Bpnt->Weight() );
-      bestArray.addResult( Distance, &ResultDist, origI );
-      CurPos = EndPos-1;
-      ++lastpos;
-      if ( lastpos != best_distrib->end() ){
-	Bpnt = lastpos->second;
+      else if ( EndPos != EffFeat ){
+	throw( logic_error( "Exemplar testing: test should not stop before last feature" ) );
       }
-      else {
-	best_distrib = IB->NextGraphTest( CurrentFV,
-					  CurPos );
-	Bpnt = NULL;
-	if ( best_distrib ){
-	  lastpos = best_distrib->begin();
-	  if ( lastpos != best_distrib->end() ){
-	    Bpnt = lastpos->second;
+      if ( pos == EffFeat ){
+	string origI;
+	if ( Verbosity(NEAR_N) ){
+	  origI = formatInstance( Inst.FV, CurrentFV,
+				  ib_offset,
+				  num_of_features );
+	}
+	double Distance = tester->getDistance(EndPos);
+	for ( const auto& it : *best_distrib ){
+	  Vfield *Bpnt = it.second;
+	  double WDistance = WeightFun( Distance, Bpnt->Weight() );
+	  if ( WDistance > Threshold + Epsilon ){
+	    // it wouldn't change bestArray
+	    continue;
 	  }
+	  ValueDistribution ResultDist;
+	  ResultDist.SetFreq( Bpnt->Value(), Bpnt->Freq() );
+	  Threshold = bestArray.addResult( WDistance, &ResultDist, origI );
+	}
+	pos = EndPos-1;
+      }
+      if ( weights ){
+	// and so are the subtrees of the nodes above, as long as the
+	// distance to them is too big, even for the smallest weight
+	while ( pos > 0 ){
+	  double D = tester->getDistance(pos);
+	  if ( WeightFun( D, weights->smallest() ) <= Threshold + Epsilon
+	       || WeightFun( D, path_weight( IB, pos-1 ) ) <= Threshold + Epsilon )
+	    break;
+	  --pos;
 	}
       }
+      CurPos = pos;
+      best_distrib = IB->NextGraphTest( CurrentFV,
+					CurPos );
+      if ( weights ){
+	for ( size_t l=CurPos; l < EffFeat; ++l )
+	  path_weights[l] = -1.0;
+      }
     }
   }
 
@@ -1726,12 +1997,70 @@ namespace Timbl {
     GlobalMetric = getMetricClass( globalMetricOption );
     delete tester;
     tester = getTester( globalMetricOption, Features, permutation, mvd_threshold );
+    // the nearest distances depend on the metrics and weights
+    nearest_for = 0;
+    nearest_cache.clear();
+  }
+
+  void MBLClass::init_bounds( const Instance& Inst,
+			      const InstanceBase_base *IB ){
+    // for every level, the least distance between the value of Inst and
+    // any other value on that level of the tree
+    const IB_bounds *bounds = IB->Bounds();
+    if ( bounds != nearest_for ){
+      nearest_for = bounds;
+      nearest_cache.clear();
+    }
+    nearest_cache.resize( effective_feats );
+    nearest.assign( effective_feats, 0.0 );
+    for ( size_t l=1; l < effective_feats; ++l ){
+      FeatureValue *fv = Inst.FV[l];
+      // values unseen in training are recycled dummies, which stand for
+      // another string in the next instance. Those are never cached
+      bool known = fv && !fv->isUnknown();
+      if ( known ){
+	auto it = nearest_cache[l].find( fv );
+	if ( it != nearest_cache[l].end() ){
+	  nearest[l] = it->second;
+	  continue;
+	}
+      }
+      double least = DBL_MAX;
+      for ( const auto& val : bounds->levelValues( l ) ){
+	if ( val != fv ){
+	  double d = tester->valueDistance( l, val );
+	  if ( d < least )
+	    least = d;
+	}
+      }
+      if ( least == DBL_MAX )
+	least = 0.0;
+      if ( known )
+	nearest_cache[l][fv] = least;
+      nearest[l] = least;
+    }
+    if ( !path_bounds )
+      path_bounds = new IB_path_bounds();
+    path_bounds->init( IB, Inst.FV, nearest );
+  }
+
+  bool MBLClass::bounded( size_t pos, double Threshold ){
+    // can the subtree of the node on level pos-1 of the search path still
+    // have instances within Threshold? Summed like the tester does
+    if ( pos == 0 || pos > path_bounds->size() )
+      return true;
+    double least = tester->getDistance( pos );
+    for ( const auto& d : path_bounds->least( pos-1 ) ){
+      least += d;
+    }
+    return least <= Threshold;
   }
 
   void MBLClass::test_instance( const Instance& Inst,
 				InstanceBase_base *IB,
 				size_t ib_offset ){
-    vector<FeatureValue *> CurrentFV(num_of_features);
+    vector<FeatureValue *>& CurrentFV = query_fv;
+    CurrentFV.assign( num_of_features, 0 );
     double Threshold = DBL_MAX;
     size_t EffFeat = effective_feats - ib_offset;
     const ValueDistribution *best_distrib = IB->InitGraphTest( CurrentFV,
@@ -1739,6 +2068,11 @@ namespace Timbl {
 							       ib_offset,
 							       effective_feats );
     tester->init( Inst, effective_feats, ib_offset );
+    bool use_bounds = ( ib_offset == 0 && !do_best_first && IB->Bounds() );
+    if ( use_bounds ){
+      init_bounds( Inst, IB );
+      tester->setBounds( path_bounds );
+    }
     //    cerr << "start test Instance = " << &Inst << " met " << TiCC::toString(CurrentFV) << endl;
     //    cerr << "BA at start = " << bestArray << endl;
     size_t CurPos = 0;
@@ -1771,17 +2105,26 @@ namespace Timbl {
       }
       else {
 	EndPos++; // out of luck, compensate for roll-back
+	if ( IB->sortedLevel( EndPos-1 ) ){
+	  // siblings on this level are visited in order of distance,
+	  // so the remaining ones can't do better
+	  if ( --EndPos == 0 )
+	    break;
+	}
       }
       size_t pos=EndPos-1;
       //      cerr << "start rollback " << pos << endl;
       while ( true ){
 	//	cerr << "rollback " << pos << endl;
-	if ( tester->getDistance(pos) <= Threshold ){
+	if ( tester->getDistance(pos) <= Threshold
+	     && ( !use_bounds || bounded( pos, Threshold + Epsilon ) ) ){
 	  CurPos = pos;
 	  //	  cerr << "voor next test " << endl;
 	  best_distrib = IB->NextGraphTest( CurrentFV,
 					    CurPos );
 	  //	  cerr << "na next test, curpos=" << CurPos << "-" << TiCC::toString(CurrentFV) << endl;
+	  if ( use_bounds )
+	    path_bounds->invalidate( CurPos );
 	  break;
 	}
 	if ( pos == 0 )
@@ -1789,13 +2132,15 @@ namespace Timbl {
 	--pos;
       }
     }
+    tester->setBounds( 0 );
     //    cerr << "BA at end = " << bestArray << endl;
   }
 
   void MBLClass::test_instance_sim( const Instance& Inst,
 				    InstanceBase_base *IB,
 				    size_t ib_offset ){
-    vector<FeatureValue *> CurrentFV(num_of_features);
+    vector<FeatureValue *>& CurrentFV = query_fv;
+    CurrentFV.assign( num_of_features, 0 );
     size_t EffFeat = effective_feats - ib_offset;
     const ValueDistribution *best_distrib = IB->InitGraphTest( CurrentFV,
 							       &Inst.FV,
@@ -1842,18 +2187,157 @@ namespace Timbl {
     }
   }
 
+  void MBLClass::test_instance_sparse( const Instance& Inst,
+				       const IB_sparse *index ){
+    // the DotProduct and Cosine metrics only get a contribution from
+    // features that are non-zero in both the test and the training instance
+    // so we walk the postings of the non-zero test values
+    const bool cosine = GlobalMetric->type() == Cosine;
+    const size_t leaves = index->leafCount();
+    if ( sparse_acc.size() != leaves ){
+      sparse_acc.assign( leaves, 0.0 );
+      sparse_mark.assign( leaves, false );
+    }
+    sparse_touched.clear();
+    double norm = 0.0;
+    for ( size_t l=0; l < effective_feats; ++l ){
+      double x;
+      if ( index->isZero( l, Inst.FV[l] )
+	   || !index->numValue( Inst.FV[l], x ) ){
+	continue;
+      }
+      const double W = index->weights[l];
+      norm += ( x * x ) * W;
+      for ( const auto& p : index->postings[l] ){
+	if ( !sparse_mark[p.leaf] ){
+	  sparse_mark[p.leaf] = true;
+	  sparse_touched.push_back( p.leaf );
+	}
+	sparse_acc[p.leaf] += ( x * p.value ) * W;
+      }
+    }
+    double threshold = -1.0;
+    for ( const auto& leaf : sparse_touched ){
+      double sim = sparse_acc[leaf];
+      if ( cosine ){
+	sim = sim / ( sqrt( norm * index->norms[leaf] ) + Common::Epsilon );
+      }
+      double Distance = maxSimilarity - sim;
+      if ( Distance < 0.0 ){
+	if ( GlobalMetric->type() == DotProduct ){
+	  Error( "The Dot Product metric fails on your data: intermediate result too big to handle," );
+	  Info( "you might consider using the Cosine metric '-mC' " );
+	  FatalError( "timbl terminated" );
+	}
+	else {
+	  Error( "DISTANCE == " + TiCC::toString<double>(Distance) );
+	  FatalError( "we are dead" );
+	}
+      }
+      threshold = bestArray.addResult( Distance, index->dists[leaf], "" );
+    }
+    if ( threshold < 0.0 || threshold >= maxSimilarity ){
+      // not enough neighbors yet, all the other leaves are at similarity 0
+      for ( size_t leaf=0; leaf < leaves; ++leaf ){
+	if ( !sparse_mark[leaf] ){
+	  bestArray.addResult( maxSimilarity, index->dists[leaf], "" );
+	}
+      }
+    }
+    for ( const auto& leaf : sparse_touched ){
+      sparse_acc[leaf] = 0.0;
+      sparse_mark[leaf] = false;
+    }
+  }
+
+  void MBLClass::test_instance_scan( const Instance& Inst,
+				     const IB_columns *cols ){
+    //
+    // the distances to all instances of the tree, without pruning on the
+    // way down. Per level a table has the distance of every value to the
+    // test value, and the instances are done in blocks: the distances in
+    // a block grow one level at a time, in the same order as the tester
+    // adds them, and a block is left as soon as all of them are too big.
+    // Neighbors at the same distance are found in another order than
+    // test_instance() does, so it isn't used for +vn
+    //
+    const size_t block = 256;
+    const size_t leaves = cols->leafCount();
+    tester->init( Inst, effective_feats, 0 );
+    scan_table.resize( effective_feats );
+    for ( size_t l=0; l < effective_feats; ++l ){
+      const vector<FeatureValue *>& vals = cols->levelValues( l );
+      scan_table[l].resize( vals.size() );
+      for ( size_t i=0; i < vals.size(); ++i ){
+	scan_table[l][i] = tester->valueDistance( l, vals[i] );
+      }
+    }
+    scan_acc.resize( block );
+    double *acc = &scan_acc[0];
+    double Threshold = DBL_MAX;
+    for ( size_t start=0; start < leaves; start += block ){
+      const size_t len = min( block, leaves - start );
+      for ( size_t j=0; j < len; ++j ){
+	acc[j] = 0.0;
+      }
+      bool alive = true;
+      for ( size_t l=0; l < effective_feats && alive; ++l ){
+	const double *table = &scan_table[l][0];
+	const uint32_t *ids = cols->column( l ) + start;
+	for ( size_t j=0; j < len; ++j ){
+	  acc[j] += table[ids[j]];
+	}
+	if ( Threshold < DBL_MAX ){
+	  double least = acc[0];
+	  for ( size_t j=1; j < len; ++j ){
+	    least = min( least, acc[j] );
+	  }
+	  alive = ( least <= Threshold + Epsilon );
+	}
+      }
+      if ( !alive )
+	continue;
+      for ( size_t j=0; j < len; ++j ){
+	if ( acc[j] > Threshold + Epsilon )
+	  continue;
+	const ValueDistribution *dist = cols->distribution( start+j );
+	if ( dist->ZeroDist() ){
+	  // This might happen when doing LOO or CV tests
+	  continue;
+	}
+	Threshold = bestArray.addResult( acc[j], dist, "" );
+	if ( do_silly_testing )
+	  Threshold = DBL_MAX;
+      }
+    }
+  }
+
   void MBLClass::TestInstance( const Instance& Inst,
 			       InstanceBase_base *SubTree,
 			       size_t level ){
     // must be cleared for EVERY test
+    SubTree->BestFirst( 0, mvd_threshold );
     if (  doSamples() ){
       test_instance_ex( Inst, SubTree, level );
     }
     else {
-      if ( GlobalMetric->isSimilarityMetric( ) )
-	test_instance_sim( Inst, SubTree, level );
-      else
-	test_instance( Inst, SubTree, level );
+      if ( GlobalMetric->isSimilarityMetric( ) ){
+	const IB_sparse *index = SubTree->SparseIndex();
+	if ( index && level == 0 && !Verbosity(NEAR_N) )
+	  test_instance_sparse( Inst, index );
+	else
+	  test_instance_sim( Inst, SubTree, level );
+      }
+      else {
+	const IB_columns *cols = SubTree->Columns();
+	if ( cols && level == 0 && !do_best_first && !Verbosity(NEAR_N) )
+	  test_instance_scan( Inst, cols );
+	else {
+	  if ( do_best_first )
+	    SubTree->BestFirst( &PermFeatures, mvd_threshold );
+	  test_instance( Inst, SubTree, level );
+	}
+      }
     }
   }
 
@@ -1895,7 +2379,7 @@ namespace Timbl {
     }
     else {
       string Buffer;
-      ifstream datafile( FileName, ios::in);
+      DataStream datafile( FileName, ios::in);
       if (!datafile) {
 	Warning( "can't open DataFile: " + FileName );
 	return 0;
@@ -2012,10 +2496,17 @@ namespace Timbl {
       PermFeatures[i] = NULL;
     }
     CurrInst.Init( num_of_features );
-    effective_feats = num_of_features;
-    num_of_num_features = 0;
+    sparse_fresh = false;
     delete GlobalMetric;
     GlobalMetric = getMetricClass( globalMetricOption );
+    set_feature_metrics();
+    Options.FreezeTable();
+  }
+
+  void MBLClass::set_feature_metrics(){
+    effective_feats = num_of_features;
+    sparse_fresh = false;
+    num_of_num_features = 0;
     // the user thinks about features running from 1 to Num
     // we know better, so shift the UserOptions one down.
     for ( size_t j = 0; j < num_of_features; ++j ){
@@ -2025,16 +2516,38 @@ namespace Timbl {
 	effective_feats--;
       }
       else {
+	Features[j]->Ignore( false );
 	Features[j]->setMetricType( m );
 	if ( Features[j]->isNumerical() ){
 	  num_of_num_features++;
 	}
       }
     }
-    Options.FreezeTable();
     if ( Weighting > IG_w ||
-	 TreeOrder >= X2Order )
+	 ( TreeOrder >= X2Order && TreeOrder != SearchOrder ) )
       need_all_weights = true;
   }
 
+  bool MBLClass::initSharedArrays(){
+    // fill the probability arrays of all features, numeric ones included,
+    // so copies with other metrics can use them without changing them
+    bool result = true;
+    size_t Dim = Targets->ValuesArray.size();
+    for ( auto const& feat : Features ){
+      if ( !result )
+	break;
+      if ( !feat->Ignore() ){
+	result = feat->AllocSparseArrays( Dim );
+	if ( result ){
+	  feat->ClipFreq( (int)rint(clip_factor *
+				    log((double)feat->EffectiveValues())));
+	  if ( !feat->ArrayRead() ){
+	    feat->InitSparseArrays();
+	  }
+	}
+      }
+    }
+    return result;
+  }
+
 } // namespace
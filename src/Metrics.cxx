@@ -32,6 +32,9 @@
 #include <sstream>
 #include <cstdlib>
 #include <climits>
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
 
 #include "timbl/Common.h"
 #include "timbl/MsgClass.h"
@@ -49,120 +52,108 @@ namespace Timbl{
 
   const double maxSimilarity = std::numeric_limits<int>::max();
 
-  double lv_distance( const string& source, const string& target ){
-    // code taken from: http://www.merriampark.com/ldcpp.htm
+  size_t lv_distance( const string& source, const string& target,
+		      size_t max_d, vector<size_t>& rows ){
+    // code derived from: http://www.merriampark.com/ldcpp.htm
     //    Levenshtein Distance Algorithm: C++ Implementation
     //                  by Anders Sewerin Johansen
-    // Step 1
+    // Only the last three rows of the matrix are kept.
+    // When the distance is sure to exceed max_d, we stop, and return a
+    // lower bound which is larger than max_d
     const size_t n = source.length();
     const size_t m = target.length();
     if (n == 0) {
-      return (double)m;
+      return m;
     }
     if (m == 0) {
-      return (double)n;
+      return n;
     }
-    // Good form to declare a TYPEDEF
-    typedef std::vector< std::vector<size_t> > Tmatrix;
-    Tmatrix matrix(n+1);
-
-    // Size the vectors in the 2.nd dimension. Unfortunately C++ doesn't
-    // allow for allocation on declaration of 2.nd dimension of vec of vec
-
-    for ( size_t i = 0; i <= n; ++i ) {
-      matrix[i].resize(m+1);
-    }
-    // Step 2
-    for ( size_t i = 0; i <= n; ++i ) {
-      matrix[i][0]=i;
+    const size_t diff = ( n > m ) ? n - m : m - n;
+    if ( diff > max_d ){
+      return diff;
     }
-    for ( size_t i = 0; i <= m; ++i ) {
-      matrix[0][i]=i;
+    rows.resize( 3*(m+1) );
+    size_t *before = &rows[0];
+    size_t *above = before + m + 1;
+    size_t *row = above + m + 1;
+    for ( size_t j = 0; j <= m; ++j ) {
+      above[j] = j;
     }
-    // Step 3
+    size_t above_min = 0;
     for ( size_t i = 1; i <= n; ++i ) {
       const char s_i = source[i-1];
-      // Step 4
+      row[0] = i;
+      size_t row_min = i;
       for ( size_t j = 1; j <= m; ++j ) {
 	const char t_j = target[j-1];
-	// Step 5
-	int cost;
-	if (s_i == t_j) {
-	  cost = 0;
-	}
-	else {
-	  cost = 1;
-	}
-	// Step 6
-	const size_t above = matrix[i-1][j];
-	const size_t left = matrix[i][j-1];
-	const size_t diag = matrix[i-1][j-1];
-	size_t cell = min( above + 1, min(left + 1, diag + cost));
-	// Step 6A: Cover transposition, in addition to deletion,
+	const size_t cost = ( s_i == t_j ) ? 0 : 1;
+	size_t cell = min( above[j] + 1, min( row[j-1] + 1, above[j-1] + cost ) );
+	// Cover transposition, in addition to deletion,
 	// insertion and substitution. This step is taken from:
 	// Berghel, Hal ; Roach, David : "An Extension of Ukkonen's
 	// Enhanced Dynamic Programming ASM Algorithm"
 	// (http://www.acm.org/~hlb/publications/asm/asm.html)
 	if (i>2 && j>2) {
-	  size_t trans=matrix[i-2][j-2]+1;
+	  size_t trans = before[j-2] + 1;
 	  if (source[i-2]!=t_j) trans++;
 	  if (s_i!=target[j-2]) trans++;
 	  if (cell>trans) cell=trans;
 	}
-	matrix[i][j]=cell;
+	row[j] = cell;
+	if ( cell < row_min ){
+	  row_min = cell;
+	}
       }
+      if ( row_min > max_d && above_min > max_d ){
+	// every cell in the next rows is derived from these two rows, or
+	// from its first column, which is larger still
+	return min( row_min, above_min );
+      }
+      above_min = row_min;
+      size_t *tmp = before;
+      before = above;
+      above = row;
+      row = tmp;
     }
-    return (double)matrix[n][m];
+    return above[m];
   }
 
-  double dc_distance( const string& string1, const string& string2 ){
-    // code taken from:
-    // http://en.wikibooks.org/wiki/Algorithm_implementation/Strings/Dice's_coefficient
-    unsigned int ls1 = string1.length();
-    unsigned int ls2 = string2.length();
-    double dice;
-    int overlap = 0;
-    int total = 0;
-    if ( ls1 <= 1 || ls2 <= 1 ){
-      // back-off naar unigrammen
-      set<char> string1_unigrams;
-      set<char> string2_unigrams;
-
-      for( const auto& c : string1 ){
-	string1_unigrams.insert(c);
-      }
-      for( const auto& c : string2 ){
-	string2_unigrams.insert(c);
+  static void ngrams( const string& s, vector<uint16_t>& unigrams,
+		      vector<uint16_t>& bigrams ){
+    // the distinct unigrams and bigrams of s, sorted
+    unigrams.clear();
+    bigrams.clear();
+    for ( size_t i = 0; i < s.length(); ++i ) {
+      unigrams.push_back( (unsigned char)s[i] );
+      if ( i+1 < s.length() ){
+	bigrams.push_back( ((unsigned char)s[i] << 8 ) | (unsigned char)s[i+1] );
       }
-
-      for ( const auto& ug : string2_unigrams ){
-	if ( string1_unigrams.find( ug ) != string1_unigrams.end() )
-	  ++overlap;
-      }
-      total = string1_unigrams.size() + string2_unigrams.size();
     }
-    else {
-      set<string> string1_bigrams;
-      set<string> string2_bigrams;
+    sort( unigrams.begin(), unigrams.end() );
+    unigrams.erase( unique( unigrams.begin(), unigrams.end() ), unigrams.end() );
+    sort( bigrams.begin(), bigrams.end() );
+    bigrams.erase( unique( bigrams.begin(), bigrams.end() ), bigrams.end() );
+  }
 
-      for( unsigned int i = 0; i < (ls1 - 1); ++i ) {
-	// extract character bigrams from string1
-	string1_bigrams.insert(string1.substr(i, 2));
+  static size_t overlap( const vector<uint16_t>& v1,
+			 const vector<uint16_t>& v2 ){
+    size_t result = 0;
+    auto it1 = v1.begin();
+    auto it2 = v2.begin();
+    while ( it1 != v1.end() && it2 != v2.end() ){
+      if ( *it1 < *it2 ){
+	++it1;
       }
-      for( unsigned int i = 0; i < (ls2 - 1); ++i ) {
-	// extract character bigrams from string2
-	string2_bigrams.insert(string2.substr(i, 2));
+      else if ( *it2 < *it1 ){
+	++it2;
       }
-
-      for ( const auto& bg : string2_bigrams ){
-	if ( string1_bigrams.find( bg ) != string1_bigrams.end() )
-	  ++overlap;
+      else {
+	++result;
+	++it1;
+	++it2;
       }
-      total = string1_bigrams.size() + string2_bigrams.size();
     }
-    dice = (double)(overlap * 2) / (double)total;
-    // we will return 1 - dice coefficient as distance
-    return 1.0 - dice;
+    return result;
   }
 
   double vd_distance( SparseValueProbClass *r, SparseValueProbClass *s ){
@@ -383,22 +374,89 @@ namespace Timbl{
     return result;
   }
 
-  double LevenshteinMetric::distance( FeatureValue *F, FeatureValue *G,
-				      size_t, double) const {
+  const size_t max_pair_cache = 100000;
+
+  double stringMetricClass::distance( FeatureValue *F, FeatureValue *G,
+				      size_t limit, double ) const {
+    return bounded_distance( F, G, limit, DBL_MAX );
+  }
+
+  double stringMetricClass::bounded_distance( FeatureValue *F,
+					      FeatureValue *G,
+					      size_t,
+					      double bound ) const {
     double result = 0.0;
     if ( G != F ){
-      result = lv_distance( F->Name(), G->Name() );
+      // values unseen in training have index 0, and are recycled
+      uint64_t key = 0;
+      if ( !F->isUnknown() && !G->isUnknown() ){
+	uint64_t i1 = F->Index();
+	uint64_t i2 = G->Index();
+	key = ( i1 < i2 ) ? ( i1 << 32 ) | i2 : ( i2 << 32 ) | i1;
+	auto it = pair_cache.find( key );
+	if ( it != pair_cache.end() ){
+	  return it->second;
+	}
+      }
+      if ( string_distance( F, G, bound, result ) && key != 0 ){
+	if ( pair_cache.size() >= max_pair_cache ){
+	  pair_cache.clear();
+	}
+	pair_cache[key] = result;
+      }
     }
     return result;
   }
 
-  double DiceMetric::distance( FeatureValue *F, FeatureValue *G,
-			       size_t, double ) const {
-    double result = 0.0;
-    if ( G != F ){
-      result = dc_distance( F->Name(), G->Name() );
+  bool LevenshteinMetric::string_distance( FeatureValue *F, FeatureValue *G,
+					   double bound,
+					   double& result ) const {
+    // distances are whole numbers. Stop only when we are well over the
+    // bound, so rounding can't make the caller miss it
+    size_t max_d = SIZE_MAX;
+    if ( bound < (double)(SIZE_MAX/2) ){
+      max_d = ( bound < 0 ) ? 0 : (size_t)bound + 1;
     }
-    return result;
+    size_t dist = lv_distance( F->Name(), G->Name(), max_d, rows );
+    result = (double)dist;
+    return dist <= max_d;
+  }
+
+  const DiceMetric::signature& DiceMetric::get_signature( FeatureValue *F,
+							  signature& tmp ) const {
+    if ( F->isUnknown() ){
+      ngrams( F->Name(), tmp.unigrams, tmp.bigrams );
+      return tmp;
+    }
+    auto it = signatures.find( F->Index() );
+    if ( it == signatures.end() ){
+      it = signatures.insert( make_pair( F->Index(), signature() ) ).first;
+      ngrams( F->Name(), it->second.unigrams, it->second.bigrams );
+    }
+    return it->second;
+  }
+
+  bool DiceMetric::string_distance( FeatureValue *F, FeatureValue *G,
+				    double, double& result ) const {
+    // see:
+    // http://en.wikibooks.org/wiki/Algorithm_implementation/Strings/Dice's_coefficient
+    const signature& s1 = get_signature( F, scratch1 );
+    const signature& s2 = get_signature( G, scratch2 );
+    int overlapping;
+    int total;
+    if ( F->Name().length() <= 1 || G->Name().length() <= 1 ){
+      // back-off naar unigrammen
+      overlapping = overlap( s1.unigrams, s2.unigrams );
+      total = s1.unigrams.size() + s2.unigrams.size();
+    }
+    else {
+      overlapping = overlap( s1.bigrams, s2.bigrams );
+      total = s1.bigrams.size() + s2.bigrams.size();
+    }
+    double dice = (double)(overlapping * 2) / (double)total;
+    // we will return 1 - dice coefficient as distance
+    result = 1.0 - dice;
+    return true;
   }
 
   double ValueDiffMetric::distance( FeatureValue *F, FeatureValue *G,
@@ -0,0 +1,215 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "timbl/MsgClass.h"
+#include "timbl/Common.h"
+#include "timbl/Types.h"
+#include "timbl/Options.h"
+#include "timbl/Instance.h"
+#include "timbl/Statistics.h"
+#include "timbl/neighborSet.h"
+#include "timbl/BestArray.h"
+#include "timbl/IBtree.h"
+#include "timbl/MBLClass.h"
+#include "timbl/DataStream.h"
+#include "timbl/TimblExperiment.h"
+
+using namespace std;
+
+namespace Timbl {
+
+  // the number of training instances used to compare orderings, how
+  // many of them are used as queries, and the most passes over the
+  // features
+  static const size_t order_sample = 5000;
+  static const size_t order_queries = 200;
+  static const int order_passes = 5;
+
+  class orderSample {
+    // a training instance, with its values in the initial tree order
+  public:
+    vector<FeatureValue *> fv;
+    TargetValue *tv;
+    double weight;
+    int occ;
+  };
+
+  static void fill_instance( Instance& inst, const orderSample& s,
+			     const vector<size_t>& pick ){
+    inst.clear();
+    for ( size_t k=0; k < pick.size(); ++k ){
+      inst.FV[k] = s.fv[pick[k]];
+    }
+    inst.TV = s.tv;
+    inst.ExemplarWeight( s.weight );
+    inst.Occurrences( s.occ );
+  }
+
+  unsigned long TimblExperiment::orderCost( const vector<orderSample>& sample,
+					    size_t queries,
+					    const vector<size_t>& slot ){
+    //
+    // the number of nodes visited when the first queries instances of
+    // sample are searched for in a tree of the others, which is built
+    // in the current permutation
+    //
+    size_t eff = EffectiveFeatures();
+    forget_sparse();
+    vector<size_t> pick( eff );
+    for ( size_t k=0; k < eff; ++k ){
+      PermFeatures[k] = Features[permutation[k]];
+      pick[k] = slot[permutation[k]];
+    }
+    initTesters();
+    InstanceBase = new IB_InstanceBase( eff, ibCount, (RandomSeed()>=0) );
+    for ( size_t i=queries; i < sample.size(); ++i ){
+      fill_instance( CurrInst, sample[i], pick );
+      InstanceBase->AddInstance( CurrInst );
+    }
+    initSearch();
+    // a linear scan or a sparse index doesn't depend on the order
+    InstanceBase->DropColumns();
+    InstanceBase->DropSparseIndex();
+    InstanceBase->resetVisits();
+    for ( size_t i=0; i < queries; ++i ){
+      fill_instance( CurrInst, sample[i], pick );
+      bestArray.init( num_of_neighbors, MaxBests,
+		      Verbosity(NEAR_N), Verbosity(DISTANCE),
+		      Verbosity(DISTRIB) );
+      TestInstance( CurrInst, InstanceBase );
+    }
+    unsigned long result = InstanceBase->NodeVisits();
+    delete InstanceBase;
+    InstanceBase = 0;
+    return result;
+  }
+
+  void TimblExperiment::searchTreeOrder(){
+    //
+    // improve the permutation made by set_order() for the IB1 search:
+    // swap neighbouring features as long as that reduces the number of
+    // nodes visited by searches with a sample of the training data.
+    // Distances don't depend on the order, so neither do the results
+    //
+    size_t eff = EffectiveFeatures();
+    if ( eff < 3 ){
+      // no tree to reorder below the top level
+      if ( !Verbosity(SILENT) )
+	writePermutation( *mylog );
+      return;
+    }
+    runningPhase = TrainWords;
+    // a uniform sample of the lines, with a fixed seed so every run
+    // chooses the same order
+    vector<orderSample> sample;
+    {
+      DataStream datafile( CurrentDataFile, ios::in );
+      cacheScope use_cache( this, CurrentDataFile, datafile );
+      if ( InputFormat() == ARFF )
+	skipARFFHeader( datafile );
+      mt19937 gen( 4711 );
+      size_t seen = 0;
+      string Buffer;
+      while ( nextLine( datafile, Buffer ) ){
+	if ( !chopLine( Buffer ) )
+	  continue;
+	size_t pos = sample.size();
+	if ( pos == order_sample ){
+	  pos = gen() % ( seen + 1 );
+	}
+	++seen;
+	if ( pos >= order_sample )
+	  continue;
+	if ( pos == sample.size() )
+	  sample.resize( pos + 1 );
+	chopped_to_instance( TrainWords );
+	orderSample& s = sample[pos];
+	s.fv.assign( CurrInst.FV.begin(), CurrInst.FV.begin() + eff );
+	s.tv = CurrInst.TV;
+	s.weight = CurrInst.ExemplarWeight();
+	s.occ = CurrInst.Occurrences();
+      }
+    }
+    stats.clear();
+    // the sample is in random order, so its head is a random subset
+    size_t queries = min( order_queries, sample.size() / 5 );
+    if ( queries == 0 ){
+      if ( !Verbosity(SILENT) )
+	writePermutation( *mylog );
+      return;
+    }
+    vector<size_t> slot( NumOfFeatures(), 0 );
+    for ( size_t k=0; k < eff; ++k ){
+      slot[permutation[k]] = k;
+    }
+    VerbosityFlags keep_verbosity = get_verbosity();
+    unsigned long keep_count = ibCount;
+    set_verbosity( keep_verbosity | SILENT );
+    // weights, probability arrays and value difference matrices. Not
+    // those of LOO, which expects a complete InstanceBase
+    TimblExperiment::initExperiment();
+    unsigned long first = orderCost( sample, queries, slot );
+    unsigned long best = first;
+    bool improved = true;
+    for ( int pass=0; improved && pass < order_passes; ++pass ){
+      improved = false;
+      for ( size_t k=0; k+1 < eff; ++k ){
+	swap( permutation[k], permutation[k+1] );
+	unsigned long cost = orderCost( sample, queries, slot );
+	if ( cost < best ){
+	  best = cost;
+	  improved = true;
+	}
+	else {
+	  swap( permutation[k], permutation[k+1] );
+	}
+      }
+    }
+    for ( size_t k=0; k < eff; ++k ){
+      PermFeatures[k] = Features[permutation[k]];
+    }
+    // the real experiment starts afresh
+    MBL_init = false;
+    ibCount = keep_count;
+    set_verbosity( keep_verbosity );
+    if ( !Verbosity(SILENT) ){
+      Info( "Search cost ordering: " + TiCC::toString( first/(double)queries )
+	    + " nodes visited per search for the "
+	    + TiCC::toString( GRoverFeature, true )
+	    + " order, " + TiCC::toString( best/(double)queries )
+	    + " for the chosen one" );
+      writePermutation( *mylog );
+    }
+  }
+
+}
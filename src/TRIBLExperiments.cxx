@@ -180,8 +180,8 @@ namespace Timbl {
     return Res;
   }
 
-  bool TRIBL_Experiment::checkLine( const string& line ){
-    if ( !TimblExperiment::checkLine( line ) )
+  bool TRIBL_Experiment::checkTestable( InputFormatType IF ){
+    if ( !TimblExperiment::checkTestable( IF ) )
       return false;
     else if ( IBStatus() == Pruned ){
       Warning( "you tried to apply the TRIBL algorithm on a pruned "
@@ -191,8 +191,8 @@ namespace Timbl {
     return true;
   }
 
-  bool TRIBL2_Experiment::checkLine( const string& line ){
-    if ( !TimblExperiment::checkLine( line ) )
+  bool TRIBL2_Experiment::checkTestable( InputFormatType IF ){
+    if ( !TimblExperiment::checkTestable( IF ) )
       return false;
     else if ( IBStatus() == Pruned ){
       Warning( "you tried to apply the TRIBL2 algorithm on a pruned "
@@ -328,6 +328,7 @@ namespace Timbl {
 	  else
 	    PermFeatures[pos++] = Features[permutation[i]];
 	}
+	InstanceBase->ReadThreads( Clones() );
 	if ( Hashed )
 	  result = InstanceBase->ReadIB( is, PermFeatures,
 					 Targets,
@@ -375,6 +376,7 @@ namespace Timbl {
 	  else
 	    PermFeatures[pos++] = Features[permutation[i]];
 	}
+	InstanceBase->ReadThreads( Clones() );
 	if ( Hashed )
 	  result = InstanceBase->ReadIB( is, PermFeatures,
 					 Targets,
@@ -32,12 +32,14 @@
 #include <sstream>
 #include <cstdlib>
 #include <climits>
+#include <cfloat>
 
 #include "timbl/Common.h"
 #include "timbl/Types.h"
 #include "timbl/Instance.h"
 #include "timbl/Metrics.h"
 #include "timbl/Testers.h"
+#include "timbl/IBtree.h"
 
 using namespace std;
 using Common::Epsilon;
@@ -49,7 +51,8 @@ namespace Timbl{
 
   double overlapTestFunction::test( FeatureValue *F,
 				    FeatureValue *G,
-				    Feature *Feat ) const {
+				    Feature *Feat,
+				    double ) const {
 #ifdef DBGTEST
     cerr << "overlap_distance(" << F << "," << G << ") = ";
 #endif
@@ -66,15 +69,19 @@ namespace Timbl{
 
   double valueDiffTestFunction::test( FeatureValue *F,
 				      FeatureValue *G,
-				      Feature *Feat ) const {
+				      Feature *Feat,
+				      double bound ) const {
 #ifdef DBGTEST
     cerr << toString(Feat->getMetricType()) << "_distance(" << F << "," << G << ") = ";
 #endif
-    double result = Feat->fvDistance( F, G, threshold );
+    // bound is what the weighted distance may add before the test fails
+    double W = Feat->Weight();
+    double result = Feat->fvDistance( F, G, threshold,
+				      W > 0.0 ? bound/W : DBL_MAX );
 #ifdef DBGTEST
     cerr << result;
 #endif
-    result *= Feat->Weight();
+    result *= W;
 #ifdef DBGTEST
     cerr << " gewogen " << result << endl;
 #endif
@@ -95,6 +102,7 @@ namespace Timbl{
 
   TesterClass::TesterClass( const vector<Feature*>& feat,
 			    const vector<size_t>& perm ):
+    bounds(0),
     _size(feat.size()),
     effSize(_size),
     offSet(0),
@@ -171,7 +179,8 @@ namespace Timbl{
 #endif
       double result = metricTest[permutation[TrueF]]->test( (*FV)[TrueF],
 							    G[i],
-							    permFeatures[TrueF] );
+							    permFeatures[TrueF],
+							    Threshold - distances[i] );
       distances[i+1] = distances[i] + result;
       if ( distances[i+1] > Threshold ){
 #ifdef DBGTEST
@@ -180,6 +189,18 @@ namespace Timbl{
 #endif
 	return i;
       }
+      if ( bounds && i < bounds->size() ){
+	// add the least distances that the features below this node can
+	// add, in the same order as above. So never more than the distance
+	// of any instance below it
+	double least = distances[i+1];
+	for ( const auto& d : bounds->least( i ) ){
+	  least += d;
+	}
+	if ( least > Threshold ){
+	  return i;
+	}
+      }
     }
 #ifdef DBGTEST
     	cerr << "threshold reached at end, distance=" << distances[effSize] << endl;
@@ -191,6 +212,16 @@ namespace Timbl{
     return distances[pos];
   }
 
+  double DistanceTester::valueDistance( size_t pos, FeatureValue *G ) const {
+    // the weighted distance between G and the value of the test instance
+    // on position pos
+    size_t TrueF = pos + offSet;
+    return metricTest[permutation[TrueF]]->test( (*FV)[TrueF],
+						 G,
+						 permFeatures[TrueF],
+						 DBL_MAX );
+  }
+
   inline bool FV_to_real( FeatureValue *FV, double &result ){
     if ( FV ){
       if ( TiCC::stringTo<double>( FV->Name(), result ) )
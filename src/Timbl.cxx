@@ -30,6 +30,7 @@
 #include <vector>
 #include <iosfwd>
 #include <string>
+#include <set>
 #include <fstream>
 #include <cstdio>
 #include <cstdlib>
@@ -75,6 +76,8 @@ string WgtOutFile = "";
 string ProbInFile = "";
 string ProbOutFile = "";
 string NamesFile = "";
+string GridFile = "";
+size_t GridMemory = 0;
 
 inline void usage_full(void){
   cerr << "usage: timbl -f data-file {-t test-file} [options]" << endl;
@@ -114,10 +117,40 @@ inline void usage_full(void){
   cerr << "-w f:n    : read Weight n from file 'f'" << endl;
   cerr << "-b n      : number of lines used for bootstrapping (IB2 only)"
        << endl;
+  cerr << "--bestfirst : visit the branches of features with a prestored"
+       << endl
+       << "              value difference matrix in order of distance" << endl;
+  cerr << "--bounds=<n> : keep summaries of the values below the nodes of the"
+       << endl
+       << "              top 'n' levels of the tree, to skip more of the IB1 search"
+       << endl;
+  cerr << "--scan=<yes|no|auto> : search the instances with a linear scan instead"
+       << endl
+       << "              of the tree. (default auto: when the tree hardly shares paths)"
+       << endl;
+  cerr << "--compile : compile the IGTree into hash tables for faster testing"
+       << " (IGTree only)" << endl
+       << "              not saved with -I: give it again after -i" << endl;
+  cerr << "--cache=<num> : remember the results of the last 'n' distinct test"
+       << endl
+       << "                 instances (0 = off)" << endl;
 #ifdef HAVE_OPENMP
-  cerr << "--clones=<num> : use 'n' threads for parallel testing" << endl;
+  cerr << "--clones=<num> : use 'n' threads for parallel testing, for"
+       << " reading" << endl
+       << "                 an instance base with -i, and for pruning an"
+       << " IGTree" << endl;
 #endif
+  cerr << "--data-cache=<dir> : keep pre-chopped copies of the data files in"
+       << " <dir>," << endl
+       << "                     and use them while the files are unchanged"
+       << endl;
   cerr << "--Diversify: rescale weight (see docs)" << endl;
+  cerr << "--grid=<file> : try all settings in 'file', one per line, and rank"
+       << endl
+       << "                them by accuracy. 'a|b' in a value tries both"
+       << endl;
+  cerr << "--grid-memory=<MB> : run no more grid settings at the same time"
+       << " than fit in MB" << endl;
   cerr << "-d val    : weight neighbors as function of their distance:"
        << endl;
   cerr << "     Z      : equal weights to all (default)" << endl;
@@ -128,6 +161,11 @@ inline void usage_full(void){
   cerr << "     ED:a:b : Exponential Decay with factor a and b (no whitespace!)"
        << endl;
   cerr << "-k n      : k nearest neighbors (default n = 1)" << endl;
+  cerr << "-k n1,n2,.. -d v1,v2,.. : test all combinations of the values with"
+       << endl
+       << "            one search per test instance (IB1 and IB2 only)" << endl;
+  cerr << "--sweep-out : also write an outputfile for every combination"
+       << endl;
   cerr << "-q n      : TRIBL threshold at level n" << endl;
   cerr << "-L n      : MVDM threshold at level n" << endl;
   cerr << "-R n      : solve ties at random with seed n" << endl;
@@ -145,6 +183,8 @@ inline void usage_full(void){
   cerr << "            -t <file> is mandatory" << endl;
   cerr << "Input options:" << endl;
   cerr << "-f f      : read from Datafile 'f'" << endl;
+  cerr << "            (data and test files may be gzip or zstd compressed)"
+       << endl;
   cerr << "-f f      : OR: use filenames from 'f' for CV test" << endl;
   cerr << "-F format : Assume the specified inputformat" << endl;
   cerr << "            (Compact, C4.5, ARFF, Columns, Tabbed, Binary, Sparse )"
@@ -169,6 +209,10 @@ inline void usage_full(void){
   cerr << "-I f      : dump the InstanceBase in file 'f'" << endl;
   cerr << "--matrixout=<f> store ValueDifference Matrices in file 'f'" << endl;
   cerr << "-X f      : dump the InstanceBase as XML in file 'f'" << endl;
+  cerr << "--IL=<f>[:n] dump the level statistics of an IGTree made with +D"
+       << endl
+       << "            in file 'f', starting at level n (default n = 0)"
+       << endl;
   cerr << "-n f      : create names file 'f'" << endl;
   cerr << "-p n      : show progress every n lines (default p = 100,000)"
        << endl;
@@ -219,6 +263,8 @@ inline void usage_full(void){
        << "            (necessary for using +v db with IGTree, but wastes memory otherwise)"
        << endl;
   cerr << "+H or -H  : write hashed trees (default +H)" << endl;
+  cerr << "--exactindex : use a hashed index for exact match lookup"
+       << endl;
   cerr << "-M n      : size of MaxBests Array" << endl;
   cerr << "-N n      : Number of features (default "
        << TimblAPI::Default_Max_Feats() << ")" << endl;
@@ -238,6 +284,9 @@ inline void usage_full(void){
   cerr << "       GxE: using GainRatio * SplitInfo" << endl;
   cerr << "       IxE: using InformationGain * SplitInfo" << endl;
   cerr << "       1/S: using 1/SplitInfo" << endl;
+  cerr << "       SCO: the order that needs the fewest steps to search a"
+       << endl
+       << "            sample of the data (IB1, IB2, LOO and CV only)" << endl;
   cerr << "+x or -x  : Do or don't use the exact match shortcut " << endl
        << "            (IB1 and IB2 only, default is -x)"
        << endl;
@@ -412,6 +461,15 @@ bool get_file_names( TiCC::CL_Options& opts ){
   if ( opts.extract( 'n', value ) ){
     NamesFile = correct_path( value, O_Path );
   }
+  if ( opts.extract( "grid", value ) ){
+    GridFile = correct_path( value, I_Path );
+  }
+  if ( opts.extract( "grid-memory", value ) ){
+    if ( !TiCC::stringTo<size_t>( value, GridMemory ) ){
+      cerr << "invalid value for --grid-memory: " << value << endl;
+      return false;
+    }
+  }
   if ( opts.extract( "matrixout", value ) ){
     MatrixOutFile = correct_path( value, O_Path );
   }
@@ -668,6 +726,110 @@ bool checkOutputFile( const string& name ){
   return true;
 }
 
+void expand_grid_line( const string& line, vector<string>& result ){
+  // every word with alternatives, like 1|3|5, multiplies the settings
+  result.clear();
+  vector<string> words;
+  if ( TiCC::split( line, words ) == 0 )
+    return;
+  result.push_back( "" );
+  for ( const auto& word : words ){
+    vector<string> alts;
+    TiCC::split_at( word, alts, "|" );
+    vector<string> next;
+    for ( const auto& r : result ){
+      for ( const auto& a : alts ){
+	next.push_back( r.empty() ? a : r + " " + a );
+      }
+    }
+    result.swap( next );
+  }
+}
+
+string grid_output_name( const TiCC::CL_Options& opts,
+			 const string& setting ){
+  // the default output name of the options with the setting applied
+  TiCC::CL_Options merged = opts;
+  TiCC::CL_Options grid_opts( timbl_short_opts, timbl_long_opts );
+  try {
+    grid_opts.init( setting );
+  }
+  catch ( TiCC::OptionError& ){
+    return "";
+  }
+  Algorithm keep_algo = algorithm;
+  string keep_q = Q_value;
+  string keep_perc = PercFile;
+  for ( const auto& opt : grid_opts ){
+    if ( opt.isLong() )
+      continue;
+    char c = opt.OptChar();
+    string value = opt.Option();
+    Weighting W;
+    if ( c == 'a' )
+      string_to( value, algorithm );
+    else if ( c == 'q' )
+      Q_value = value;
+    else if ( c == 'w' && string_to( value, W ) )
+      value = to_string( W );
+    while ( merged.remove( c ) );
+    merged.insert( c, value, opt.getMood() );
+  }
+  OutputFile = "";
+  Default_Output_Names( merged );
+  string result = OutputFile;
+  algorithm = keep_algo;
+  Q_value = keep_q;
+  PercFile = keep_perc;
+  return result;
+}
+
+bool Do_Grid( TimblAPI *Run, const TiCC::CL_Options& opts, bool own_output ){
+  ifstream is( GridFile );
+  if ( !is ){
+    cerr << "unable to read grid settings from '" << GridFile << "'" << endl;
+    return false;
+  }
+  if ( TestFile.empty() ){
+    cerr << "a grid search needs a testfile, or -t leave_one_out or "
+	 << "-t cross_validate" << endl;
+    return false;
+  }
+  vector<string> settings;
+  string line;
+  while ( getline( is, line ) ){
+    if ( line.empty() || line[0] == '#' )
+      continue;
+    vector<string> expanded;
+    expand_grid_line( line, expanded );
+    settings.insert( settings.end(), expanded.begin(), expanded.end() );
+  }
+  if ( settings.empty() ){
+    cerr << "no settings found in grid file '" << GridFile << "'" << endl;
+    return false;
+  }
+  vector<string> outFiles;
+  if ( !Do_CV ){
+    string base = OutputFile;
+    set<string> used;
+    for ( size_t i=0; i < settings.size(); ++i ){
+      string name;
+      if ( own_output )
+	name = base + ".grid" + TiCC::toString( i+1 );
+      else
+	name = grid_output_name( opts, settings[i] );
+      if ( name.empty() || !used.insert( name ).second ){
+	name = base + ".grid" + TiCC::toString( i+1 );
+	used.insert( name );
+      }
+      outFiles.push_back( name );
+    }
+    OutputFile = base;
+  }
+  return Run->GridSearch( dataFile, TestFile, settings, outFiles,
+			  GridMemory );
+}
+
 int main(int argc, char *argv[]){
   try {
     // Start.
@@ -702,6 +864,7 @@ int main(int argc, char *argv[]){
       usage();
       return 3;
     }
+    bool own_output = !OutputFile.empty();
     Default_Output_Names( opts );
     vector<string> mas = opts.getMassOpts();
     if ( !mas.empty() ){
@@ -709,6 +872,14 @@ int main(int argc, char *argv[]){
       usage();
       return 33;
     }
+    if ( !GridFile.empty() ){
+      bool ok = checkInputFile( GridFile ) &&
+	checkInputFile( dataFile ) &&
+	checkInputFile( TestFile ) &&
+	Do_Grid( Run, opts, own_output );
+      delete Run;
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     if ( Do_CV ){
       if ( checkInputFile( TestFile ) ){
 	Run->CVprepare( WgtInFile, WgtType, ProbInFile );
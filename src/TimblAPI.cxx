@@ -356,12 +356,27 @@ namespace Timbl {
 	return false;
       if ( out.empty() && Algo() != CV )
 	return false;
-      if ( !pimpl->Test( in, out ) )
+      bool ok;
+      if ( pimpl->Sweeping() )
+	ok = pimpl->SweepTest( in, out );
+      else
+	ok = pimpl->Test( in, out );
+      if ( !ok )
 	return false;
       return pimpl->createPercFile( p );
     }
   }
 
+  bool TimblAPI::GridSearch( const string& data,
+			     const string& test,
+			     const vector<string>& settings,
+			     const vector<string>& outs,
+			     size_t memory ){
+    if ( !Valid() || data.empty() || test.empty() )
+      return false;
+    return pimpl->GridSearch( data, test, settings, outs, memory );
+  }
+
   bool TimblAPI::NS_Test( const string& in,
 			  const string& out ){
     if ( !Valid() )
@@ -415,6 +430,38 @@ namespace Timbl {
     return NULL;
   }
 
+  size_t TimblAPI::encodeFeatureValue( size_t feature,
+				       const string& value ) const {
+    if ( Valid() ){
+      return pimpl->encodeFeatureValue( feature, value );
+    }
+    return 0;
+  }
+
+  bool TimblAPI::Classify( const vector<string>& fields,
+			   classifyResult& res ){
+    res = classifyResult();
+    if ( Valid() ){
+      res.target = pimpl->classifyFields( fields, res.distance );
+      if ( res.target ){
+	res.distribution = pimpl->resultDistribution();
+      }
+    }
+    return res.target != 0;
+  }
+
+  bool TimblAPI::Classify( const vector<size_t>& ids,
+			   classifyResult& res ){
+    res = classifyResult();
+    if ( Valid() ){
+      res.target = pimpl->classifyValues( ids, res.distance );
+      if ( res.target ){
+	res.distribution = pimpl->resultDistribution();
+      }
+    }
+    return res.target != 0;
+  }
+
   const neighborSet *TimblAPI::classifyNS( const string& s ){
     const neighborSet *ns = 0;
     if ( Valid() ){
@@ -53,6 +53,8 @@
 #include "timbl/Options.h"
 #include "timbl/Instance.h"
 #include "timbl/Choppers.h"
+#include "timbl/DataCache.h"
+#include "timbl/DataStream.h"
 #include "timbl/Metrics.h"
 #include "timbl/Statistics.h"
 #include "timbl/neighborSet.h"
@@ -75,7 +77,7 @@ using namespace std;
 namespace Timbl {
 
   const string timbl_short_opts = "a:b:B:c:C:d:De:f:F:G::hHi:I:k:l:L:m:M:n:N:o:O:p:P:q:QR:s::t:T:u:U:v:Vw:W:xX:Z%";
-  const string timbl_long_opts = ",Beam:,clones:,Diversify,occurrences:,sloppy::,silly::,Threshold:,Treeorder:,matrixin:,matrixout:,version,help";
+  const string timbl_long_opts = ",Beam:,bestfirst,bounds:,cache:,clones:,compile,data-cache:,Diversify,exactindex,grid:,grid-memory:,IL:,occurrences:,scan::,sloppy::,silly::,sweep-out,Threshold:,Treeorder:,matrixin:,matrixout:,version,help";
   const string timbl_serv_short_opts = "C:d:G::k:l:L:p:Qv:x";
   const string timbl_indirect_opts = "d:e:G:k:L:m:o:p:QR:t:v:w:x%";
 
@@ -187,6 +189,50 @@ namespace Timbl {
     // silently do nothing when dist == 0;
   }
 
+  bool classifyCache::lookup( const string& key, cachedResult& res ){
+    ++lookups;
+    const auto it = index.find( key );
+    if ( it == index.end() ){
+      return false;
+    }
+    ++hits;
+    lru.splice( lru.begin(), lru, it->second );
+    res = it->second->second;
+    if ( res.dist ){
+      // the caller gets its own copy, the cached one may be evicted
+      res.dist = res.dist->to_WVD_Copy();
+    }
+    return true;
+  }
+
+  void classifyCache::store( const string& key, const cachedResult& res ){
+    if ( limit == 0 ){
+      delete res.dist;
+      return;
+    }
+    const auto it = index.find( key );
+    if ( it != index.end() ){
+      // another clone was first
+      delete res.dist;
+      return;
+    }
+    lru.push_front( make_pair( key, res ) );
+    index[key] = lru.begin();
+    if ( lru.size() > limit ){
+      delete lru.back().second.dist;
+      index.erase( lru.back().first );
+      lru.pop_back();
+    }
+  }
+
+  void classifyCache::clear(){
+    for ( const auto& it : lru ){
+      delete it.second.dist;
+    }
+    lru.clear();
+    index.clear();
+  }
+
   void TimblExperiment::normalizeResult(){
     bestResult.prepare();
     bestResult.normalize();
@@ -204,8 +250,15 @@ namespace Timbl {
     confusionInfo( 0 ),
     match_depth(-1),
     last_leaf(true),
+    result_cache( 0 ),
     estimate( 0 ),
-    numOfThreads( 1 )
+    numOfThreads( 1 ),
+    cache_size( 0 ),
+    active_cache( 0 ),
+    cache_stream( 0 ),
+    cache_row( 0 ),
+    row_pending( false ),
+    sweep_files( false )
   {
     Weighting = GR_w;
   }
@@ -213,6 +266,16 @@ namespace Timbl {
   TimblExperiment::~TimblExperiment() {
     delete OptParams;
     delete confusionInfo;
+    for ( const auto& it : data_caches ){
+      // copies have caches of their own
+      delete it.second;
+    }
+    if ( !is_copy ){
+      delete result_cache;
+      for ( const auto& d : sweep_decays ){
+	delete d;
+      }
+    }
   }
 
   TimblExperiment& TimblExperiment::operator=( const TimblExperiment&in ){
@@ -227,10 +290,32 @@ namespace Timbl {
       Weighting = in.Weighting;
       confusionInfo = 0;
       numOfThreads = in.numOfThreads;
+      // clones share the cache of their parent
+      cache_size = in.cache_size;
+      result_cache = in.result_cache;
+      data_cache_dir = in.data_cache_dir;
     }
     return *this;
   }
 
+  void TimblExperiment::CacheSize( size_t size ){
+    if ( is_copy ){
+      return;
+    }
+    cache_size = size;
+    delete result_cache;
+    result_cache = 0;
+    if ( cache_size > 0 ){
+      result_cache = new classifyCache( cache_size );
+    }
+  }
+
+  void TimblExperiment::clearCache(){
+    if ( result_cache && !is_copy ){
+      result_cache->clear();
+    }
+  }
+
   TimblExperiment *TimblExperiment::splitChild( ) const {
     TimblExperiment *result = 0;
     switch ( Algorithm() ){
@@ -250,12 +335,27 @@ namespace Timbl {
     }
     result->WFileName = WFileName;
     result->CurrentDataFile = "";
+    // a split child may change its settings, so it can't share our cache
+    result->result_cache = 0;
+    result->cache_size = 0;
     result->InstanceBase->CleanPartition( false );
     result->InstanceBase = 0;
     result->is_synced = true;
     return result;
   }
 
+  TimblExperiment *TimblExperiment::snapshotChild() const {
+    // a child that only classifies, and shares everything with us.
+    // it is only valid as long as we don't change
+    TimblExperiment *result = clone();
+    *result = *this;
+    if ( OptParams ){
+      result->OptParams = OptParams->Clone( 0 );
+    }
+    result->initExperiment();
+    return result;
+  }
+
   void TimblExperiment::initExperiment( bool all_vd ){
     if ( !ExpInvalid() ){
       match_depth = NumOfFeatures();
@@ -282,8 +382,21 @@ namespace Timbl {
 	      }
 	    }
 	  }
-	  if ( initProbabilityArrays( all_vd ) )
+	  array_timer.reset();
+	  matrix_timer.reset();
+	  if ( initProbabilityArrays( all_vd ) ){
 	    calculatePrestored();
+	    bool storable = all_vd;
+	    for ( const auto& feat : Features ){
+	      if ( !feat->Ignore() && feat->isStorableMetric() )
+		storable = true;
+	    }
+	    if ( storable && !Verbosity(SILENT) ){
+	      Info( "Probability arrays took " + array_timer.toString()
+		    + ", value difference matrices took "
+		    + matrix_timer.toString() );
+	    }
+	  }
 	  else {
 	    Error( string("not enough memory for Probability Arrays")
 		   + "' in ("
@@ -294,7 +407,37 @@ namespace Timbl {
 	  InitWeights();
 	  if ( do_diversify )
 	    diverseWeights();
+	  if ( do_exact_index &&
+	       InstanceBase &&
+	       Algorithm() != IGTREE_a ){
+	    InstanceBase->BuildExactIndex();
+	  }
+	  if ( InstanceBase ){
+	    if ( ( Algorithm() == IB1_a || Algorithm() == IB2_a
+		   || Algorithm() == CV_a )
+		 && ( InputFormat() == Sparse || InputFormat() == SparseBin )
+		 && GlobalMetric->type() == DotProduct ){
+	      InstanceBase->IndexSparse( PermFeatures,
+					 InputFormat() == Sparse?DefaultSparseString:"0" );
+	    }
+	    else
+	      InstanceBase->DropSparseIndex();
+	    initSearch();
+	  }
 	}
+	else if ( is_synced ){
+	  // a split child has an InstanceBase and maybe a weighting
+	  // of its own
+	  InitWeights();
+	  if ( do_diversify )
+	    diverseWeights();
+	  if ( do_exact_index &&
+	       InstanceBase &&
+	       Algorithm() != IGTREE_a ){
+	    InstanceBase->BuildExactIndex();
+	  }
+	}
+	clearCache();
 	srand( random_seed );
 	initTesters();
 	MBL_init = true;
@@ -302,7 +445,175 @@ namespace Timbl {
     }
   }
 
+  void TimblExperiment::initSearch(){
+    // the summaries of the InstanceBase that speed up the IB1 search
+    if ( bound_levels > 0
+	 && ( Algorithm() == IB1_a || Algorithm() == IB2_a
+	      || Algorithm() == LOO_a || Algorithm() == CV_a ) )
+      InstanceBase->BuildBounds( bound_levels );
+    else
+      InstanceBase->DropBounds();
+    if ( linear_scan != 0
+	 && ( Algorithm() == IB1_a || Algorithm() == LOO_a
+	      || Algorithm() == CV_a )
+	 && !GlobalMetric->isSimilarityMetric()
+	 && !doSamples() && !Verbosity(NEAR_N) ){
+      if ( !InstanceBase->Columns() ){
+	// scan the instances when the tree hardly shares any paths,
+	// which is when they separate in the upper half of it
+	size_t spread = InstanceBase->SpreadLevel();
+	if ( linear_scan > 0 || 2*spread <= EffectiveFeatures() )
+	  InstanceBase->BuildColumns();
+      }
+    }
+    else
+      InstanceBase->DropColumns();
+    if ( doSamples() && ( Algorithm() == IB1_a || Algorithm() == CV_a ) )
+      InstanceBase->BuildWeights();
+    else
+      InstanceBase->DropWeights();
+  }
+
+  void TimblExperiment::attachCache( const string& FileName, istream& is,
+				     bool seeking ){
+    detachCache();
+    if ( !ChopInput ){
+      return;
+    }
+    // we can't seek in a compressed file, so serve its lines from memory.
+    // Copies, like those of a grid search, need that too, but leave the
+    // --data-cache to their parent
+    bool zipped = seeking && compressed_file( FileName );
+    bool use_dir = !data_cache_dir.empty() && !is_copy;
+    if ( !use_dir && !zipped ){
+      return;
+    }
+    DataCache *dc = 0;
+    auto it = data_caches.find( FileName );
+    if ( it != data_caches.end() ){
+      if ( it->second->matches( InputFormat(), NumOfFeatures(), F_length,
+				chopExamples(), chopOcc() )
+	   && ( zipped || !it->second->lenient() ) ){
+	dc = it->second;
+      }
+      else {
+	delete it->second;
+	data_caches.erase( it );
+      }
+    }
+    if ( !dc ){
+      dc = new DataCache( FileName, InputFormat(), NumOfFeatures(), F_length,
+			  chopExamples(), chopOcc() );
+      data_caches[FileName] = dc;
+      if ( use_dir && dc->load( data_cache_dir ) ){
+	if ( !Verbosity(SILENT) ){
+	  Info( "Using data cache for: " + FileName );
+	}
+      }
+      else if ( !use_dir ){
+	// unusable lines were reported while preparing already
+	string msg;
+	dc->build( msg, true );
+      }
+      else {
+	string msg;
+	if ( !dc->build( msg ) ){
+	  if ( zipped ){
+	    dc->build( msg, true );
+	  }
+	  else {
+	    Warning( "data cache: " + msg );
+	  }
+	}
+	else if ( !dc->save( data_cache_dir ) ){
+	  Warning( "data cache: unable to write in: " + data_cache_dir );
+	}
+	else if ( !Verbosity(SILENT) ){
+	  Info( "Stored data cache for: " + FileName );
+	}
+      }
+    }
+    if ( dc->usable() ){
+      dc->rewind();
+      active_cache = dc;
+      cache_stream = &is;
+    }
+    else if ( zipped ){
+      throw runtime_error( "can't read compressed datafile: " + FileName );
+    }
+  }
+
+  void TimblExperiment::releaseCache( const string& FileName ){
+    // the lines of a compressed datafile are only kept in memory to build
+    // the InstanceBase, without a --data-cache they may go after that
+    if ( !data_cache_dir.empty() && !is_copy ){
+      return;
+    }
+    auto it = data_caches.find( FileName );
+    if ( it != data_caches.end() ){
+      delete it->second;
+      data_caches.erase( it );
+    }
+  }
+
+  void TimblExperiment::detachCache(){
+    active_cache = 0;
+    cache_stream = 0;
+    row_pending = false;
+  }
+
+  cacheScope::cacheScope( TimblExperiment *e,
+			  const string& FileName,
+			  istream& is,
+			  bool seeking ): exp( e ){
+    exp->attachCache( FileName, is, seeking );
+  }
+
+  cacheScope::~cacheScope(){
+    exp->detachCache();
+  }
+
+  streamsize TimblExperiment::linePos( istream& is ){
+    // a position that can be handed to seekLine()
+    if ( active_cache && &is == cache_stream ){
+      return active_cache->position();
+    }
+    return is.tellg();
+  }
+
+  void TimblExperiment::seekLine( istream& is, streamsize pos ){
+    if ( active_cache && &is == cache_stream ){
+      active_cache->seek( pos );
+    }
+    else {
+      is.clear();
+      is.seekg( pos );
+    }
+  }
+
+  const DataCache *TimblExperiment::takeRow( size_t& row ){
+    // hands the row found by the last nextLine() to another experiment
+    if ( row_pending ){
+      row_pending = false;
+      row = cache_row;
+      return active_cache;
+    }
+    return 0;
+  }
+
+  bool TimblExperiment::chopRow( const DataCache *dc, size_t row ){
+    dc->restore( row, ChopInput );
+    stats.addLine();
+    return true;
+  }
+
   bool TimblExperiment::skipARFFHeader( istream& is ){
+    if ( active_cache && &is == cache_stream ){
+      for ( size_t i=0; i < active_cache->headSkips(); ++i ){
+	stats.addSkipped();
+      }
+      return true;
+    }
     string Buffer;
     while ( getline( is, Buffer ) &&
 	    !compare_nocase_n( "@DATA", Buffer) )
@@ -321,6 +632,18 @@ namespace Timbl {
     //
     bool found = false;
     cnt = 0;
+    if ( active_cache && &datafile == cache_stream ){
+      // the line is already chopped, chopLine() will fetch it
+      size_t gap;
+      found = active_cache->next( gap, cache_row );
+      for ( size_t i=0; i < gap; ++i ){
+	stats.addSkipped();
+      }
+      cnt = gap + (found?1:0);
+      row_pending = found;
+      Line.clear();
+      return found;
+    }
     while ( !found && getline( datafile, Line ) ){
       ++cnt;
       if ( empty_line( Line, InputFormat() ) ){
@@ -334,6 +657,10 @@ namespace Timbl {
   }
 
   bool TimblExperiment::chopLine( const string& Line ){
+    if ( row_pending ){
+      row_pending = false;
+      return chopRow( active_cache, cache_row );
+    }
     if ( !Chop( Line ) ){
       stats.addSkipped();
       return false;
@@ -384,7 +711,8 @@ namespace Timbl {
 	    }
 	    // Open the file.
 	    //
-	    ifstream datafile( FileName, ios::in);
+	    DataStream datafile( FileName, ios::in);
+	    cacheScope use_cache( this, FileName, datafile );
 	    stats.clear();
 	    string Buffer;
 	    if ( InputFormat() == ARFF )
@@ -429,6 +757,7 @@ namespace Timbl {
 		Error( "no useful data in: " + FileName );
 	      }
 	      else {
+		stat_timer.reset();
 		if ( !Verbosity(SILENT) ){
 		  time_stamp( "Finished:  ", stats.totalLines() );
 		  time_stamp( "Calculating Entropy " );
@@ -440,12 +769,17 @@ namespace Timbl {
 			     << stats.skippedLines() << endl;
 		    LearningInfo( *mylog );
 		  }
+		  else
+		    calculate_fv_entropy( false );
 		}
 		else
 		  calculate_fv_entropy( false );
 		prepT.stop();
 		if ( !Verbosity(SILENT) )
-		  Info( "Preparation took " + prepT.toString() );
+		  Info( "Preparation took " + prepT.toString()
+			+ " (feature statistics: " + stat_timer.toString()
+			+ ", using " + TiCC::toString( Clones() )
+			+ " thread(s))" );
 		if ( warnOnSingleTarget && Targets->EffectiveValues() <=1 ){
 		  Warning( "Training file contains only 1 class." );
 		}
@@ -485,8 +819,7 @@ namespace Timbl {
     while ( fit != fi.end() ){
       set<streamsize>::const_iterator sit = fit->second.begin();
       while ( sit != fit->second.end() ){
-	datafile.clear();
-	datafile.seekg( *sit );
+	seekLine( datafile, *sit );
 	string Buffer;
 	nextLine( datafile, Buffer );
 	chopLine( Buffer );
@@ -495,12 +828,15 @@ namespace Timbl {
 	if (( stats.dataLines() % Progress() ) == 0)
 	  time_stamp( "Learning:  ", stats.dataLines() );
 	chopped_to_instance( TrainWords );
-	if ( !outInstanceBase )
+	if ( !outInstanceBase ){
 	  outInstanceBase = InstanceBase->clone();
+	  outInstanceBase->sharePool( InstanceBase );
+	}
 	//		  cerr << "add instance " << &CurrInst << endl;
 	if ( !outInstanceBase->AddInstance( CurrInst ) ){
 	  Warning( "deviating exemplar weight in:\n" +
-		   Buffer + "\nIgnoring the new weight" );
+		   ( Buffer.empty()?get_org_input():Buffer ) +
+		   "\nIgnoring the new weight" );
 	}
 	++sit;
       }
@@ -564,7 +900,8 @@ namespace Timbl {
 	  }
 	  // Open the file.
 	  //
-	  ifstream datafile( CurrentDataFile, ios::in);
+	  DataStream datafile( CurrentDataFile, ios::in);
+	  cacheScope use_cache( this, CurrentDataFile, datafile, true );
 	  //
 	  learnFromFileIndex( fmIndex, datafile );
 	}
@@ -586,7 +923,8 @@ namespace Timbl {
 	  }
 	  // Open the file.
 	  //
-	  ifstream datafile( CurrentDataFile, ios::in);
+	  DataStream datafile( CurrentDataFile, ios::in);
+	  cacheScope use_cache( this, CurrentDataFile, datafile, true );
 	  //
 	  fileDoubleIndex::const_iterator mit = fIndex.begin();
 	  while ( mit != fIndex.end() ){
@@ -617,7 +955,9 @@ namespace Timbl {
 	 !ConfirmOptions() ){
       return false;
     }
-    return ClassicLearn( s, warnOnSingleTarget );
+    bool result = ClassicLearn( s, warnOnSingleTarget );
+    releaseCache( CurrentDataFile );
+    return result;
   }
 
   IB1_Experiment::IB1_Experiment( const size_t N,
@@ -648,6 +988,8 @@ namespace Timbl {
       else {
 	chopped_to_instance( TrainLearnWords );
 	MBL_init = false;
+	clearCache();
+	refresh_arrays( CurrInst );
 	bool happy = InstanceBase->AddInstance( CurrInst );
 	if ( !happy )
 	  Warning( "deviating exemplar weight in:\n" +
@@ -677,6 +1019,7 @@ namespace Timbl {
       else {
 	chopped_to_instance( TestWords );
 	HideInstance( CurrInst );
+	clearCache();
       }
     }
     return result;
@@ -710,7 +1053,7 @@ namespace Timbl {
       stats.clear();
       // Open the file.
       //
-      ifstream datafile( FileName, ios::in);
+      DataStream datafile( FileName, ios::in);
       if ( InputFormat() == ARFF )
 	skipARFFHeader( datafile );
       if ( !nextLine( datafile, Buffer ) ){
@@ -723,6 +1066,10 @@ namespace Timbl {
       }
       else {
 	MBL_init = false;
+	clearCache();
+	for ( const auto& feat : Features ){
+	  feat->clear_matrix();
+	}
 	if ( !Verbosity(SILENT) ) {
 	  Info( "Phase 2: Expanding from Datafile: " + FileName );
 	  time_stamp( "Start:     ", 0 );
@@ -780,7 +1127,7 @@ namespace Timbl {
       stats.clear();
       // Open the file.
       //
-      ifstream datafile( FileName, ios::in);
+      DataStream datafile( FileName, ios::in);
       if ( InputFormat() == ARFF )
 	skipARFFHeader( datafile );
       if ( !nextLine( datafile, Buffer ) ){
@@ -792,6 +1139,7 @@ namespace Timbl {
 	result = false;    // No more input
       }
       else {
+	clearCache();
 	if ( !Verbosity(SILENT) ) {
 	  Info( "Phase 2: Removing using Datafile: " + FileName );
 	  time_stamp( "Start:     ", 0 );
@@ -962,28 +1310,48 @@ namespace Timbl {
     os << "Seconds taken: " << secsUsed << " (";
     os << setprecision(2);
     os << stats.dataLines() / secsUsed << " p/s)" << endl;
+    if ( result_cache && result_cache->Lookups() > 0 ){
+      os << "Result cache : " << result_cache->Hits() << "/"
+	 << result_cache->Lookups() << " hits ("
+	 << 100.0 * result_cache->Hits() / result_cache->Lookups()
+	 << "%), " << result_cache->size() << " of "
+	 << result_cache->Limit() << " entries in use" << endl;
+    }
+    if ( InstanceBase && InstanceBase->NodeVisits() > 0
+	 && ( do_best_first || Verbosity(ADVANCED_STATS) ) ){
+      os << "Nodes visited: " << InstanceBase->NodeVisits() << " ("
+	 << InstanceBase->NodeVisits() / (double)max( 1u, stats.dataLines() )
+	 << " per instance)" << endl;
+    }
     os << setprecision(oldPrec);
   }
 
   bool TimblExperiment::showStatistics( ostream& os ) const {
+    show_statistics( os, stats, confusionInfo );
+    return true;
+  }
+
+  void TimblExperiment::show_statistics( ostream& os,
+					 const StatisticsClass& st,
+					 const ConfusionMatrix *cm ) const {
     os << endl;
-    if ( confusionInfo )
-      confusionInfo->FScore( os, Targets, Verbosity(CLASS_STATS) );
+    if ( cm )
+      cm->FScore( os, Targets, Verbosity(CLASS_STATS) );
     os << "overall accuracy:        "
-       << stats.testedCorrect()/(double) stats.dataLines()
-       << "  (" << stats.testedCorrect() << "/" << stats.dataLines()  << ")" ;
-    if ( stats.exactMatches() != 0 )
-      os << ", of which " << stats.exactMatches() << " exact matches " ;
+       << st.testedCorrect()/(double) st.dataLines()
+       << "  (" << st.testedCorrect() << "/" << st.dataLines()  << ")" ;
+    if ( st.exactMatches() != 0 )
+      os << ", of which " << st.exactMatches() << " exact matches " ;
     os << endl;
-    int totalTies =  stats.tiedCorrect() + stats.tiedFailure();
+    int totalTies =  st.tiedCorrect() + st.tiedFailure();
     if ( totalTies > 0 ){
       if ( totalTies == 1 )
 	os << "There was 1 tie";
       else
 	os << "There were " << totalTies << " ties";
-      double tie_perc = 100 * ( stats.tiedCorrect() / (double)totalTies);
+      double tie_perc = 100 * ( st.tiedCorrect() / (double)totalTies);
       int oldPrec = os.precision(2);
-      os << " of which " << stats.tiedCorrect()
+      os << " of which " << st.tiedCorrect()
 	 << " (" << setprecision(2)
 	 << tie_perc << setprecision(6) << "%)";
       if ( totalTies == 1 )
@@ -992,11 +1360,10 @@ namespace Timbl {
 	os << " were correctly resolved" << endl;
       os.precision(oldPrec);
     }
-    if ( confusionInfo && Verbosity(CONF_MATRIX) ){
+    if ( cm && Verbosity(CONF_MATRIX) ){
       os << endl;
-      confusionInfo->Print( os, Targets );
+      cm->Print( os, Targets );
     }
-    return true;
   }
 
   bool TimblExperiment::createPercFile( const string& fileName ) const {
@@ -1115,7 +1482,7 @@ namespace Timbl {
 	stats.clear();
 	// Open the file.
 	//
-	ifstream datafile( CurrentDataFile, ios::in);
+	DataStream datafile( CurrentDataFile, ios::in);
 	if ( InputFormat() == ARFF )
 	  skipARFFHeader( datafile );
 	if ( !nextLine( datafile, Buffer ) ){
@@ -1235,7 +1602,7 @@ namespace Timbl {
       stats.clear();
       // Open the file.
       //
-      ifstream datafile( file_name, ios::in);
+      DataStream datafile( file_name, ios::in);
       if ( InputFormat() == ARFF )
 	skipARFFHeader( datafile );
       if ( !nextLine( datafile, Buffer ) ){
@@ -1316,6 +1683,7 @@ namespace Timbl {
 	      LearningInfo( *mylog );
 	    }
 	    MBL_init = false; // force recalculations when testing
+	    clearCache();
 	  }
 	}
       }
@@ -1410,45 +1778,67 @@ namespace Timbl {
   }
 
   bool TimblExperiment::checkLine( const string& line ){
+    if ( ExpInvalid() ||
+	 !ConfirmOptions() ) {
+      return false;
+    }
+    runningPhase = TestWords;
+    InputFormatType IF = InputFormat();
+    if ( IF == UnknownInputFormat )
+      IF = getInputFormat( line );
+    size_t i = countFeatures( line, IF );
+    if ( i != NumOfFeatures() ){
+      if ( i > 0 )
+	Warning( "mismatch between number of features in testline " +
+		 line + " and the Instancebase (" + TiCC::toString<size_t>(i)
+		 + " vs. " + TiCC::toString<size_t>(NumOfFeatures()) + ")" );
+      return false;
+    }
+    return checkTestable( IF );
+  }
+
+  bool TimblExperiment::checkFields( size_t num ){
+    // a test instance given as fields: the feature values, and
+    // optionally the target
+    if ( ExpInvalid() ||
+	 !ConfirmOptions() ) {
+      return false;
+    }
+    runningPhase = TestWords;
+    if ( num != NumOfFeatures() && num != NumOfFeatures()+1 ){
+      Warning( "mismatch between the number of fields (" +
+	       TiCC::toString<size_t>(num) + ") and the number of features in"
+	       " the Instancebase (" + TiCC::toString<size_t>(NumOfFeatures())
+	       + ")" );
+      return false;
+    }
+    return checkTestable( InputFormat() );
+  }
+
+  bool TimblExperiment::checkTestable( InputFormatType IF ){
     bool result = false;
-    if ( !ExpInvalid() &&
-	 ConfirmOptions() ) {
-      runningPhase = TestWords;
-      InputFormatType IF = InputFormat();
-      if ( IF == UnknownInputFormat )
-	IF = getInputFormat( line );
-      size_t i = countFeatures( line, IF );
-      if ( i != NumOfFeatures() ){
-	if ( i > 0 )
-	  Warning( "mismatch between number of features in testline " +
-		   line + " and the Instancebase (" + TiCC::toString<size_t>(i)
-		   + " vs. " + TiCC::toString<size_t>(NumOfFeatures()) + ")" );
-      }
-      else {
-	if ( Initialized ){
-	  result = true;
-	}
-	else if ( IBStatus() == Invalid )
-	  Warning( "no Instance Base is available yet" );
-	else if ( !setInputFormat( IF ) ){
-	  Error( "Couldn't set input format to " + TiCC::toString( IF ) );
-	}
-	else {
-	  if ( Verbosity(NEAR_N) ){
-	    Do_Exact( false );
-	  }
-	  initExperiment();
-	  Initialized = true;
-	  result = true;
-	}
+    if ( Initialized ){
+      result = true;
+    }
+    else if ( IBStatus() == Invalid )
+      Warning( "no Instance Base is available yet" );
+    else if ( IF != UnknownInputFormat && !setInputFormat( IF ) ){
+      Error( "Couldn't set input format to " + TiCC::toString( IF ) );
+    }
+    else {
+      if ( Verbosity(NEAR_N) ){
+	Do_Exact( false );
       }
+      initExperiment();
+      Initialized = true;
+      result = true;
     }
     return result;
   }
 
 
-  bool IB1_Experiment::checkLine( const string& line ){
-    if ( !TimblExperiment::checkLine( line ) )
+  bool IB1_Experiment::checkTestable( InputFormatType IF ){
+    if ( !TimblExperiment::checkTestable( IF ) )
       return false;
     else if ( IBStatus() == Pruned ){
       Warning( "you tried to apply the IB1 algorithm on a pruned"
@@ -1591,6 +1981,107 @@ namespace Timbl {
     return Res;
   }
 
+  static string cache_key( const Instance& Inst, size_t len ){
+    string key;
+    for ( size_t i=0; i < len; ++i ){
+      const FeatureValue *fv = Inst.FV[i];
+      if ( fv->isUnknown() ){
+	key += '?';
+	key += fv->Name();
+      }
+      else {
+	key += to_string( fv->Index() );
+      }
+      key += '\0';
+    }
+    return key;
+  }
+
+  const TargetValue *TimblExperiment::cachedClassify( const Instance& Inst,
+						      double& Distance,
+						      bool& exact ){
+    if ( !result_cache
+	 || Verbosity( NEAR_N | ALL_K | MATCH_DEPTH )
+	 || RandomSeed() >= 0 ){
+      // neighbor output, match depths and random tie breaking
+      // can't be replayed reliably
+      return LocalClassify( Inst, Distance, exact );
+    }
+    if ( !MBL_init ){
+      // settings have changed: this also invalidates the cache
+      initExperiment();
+    }
+    const string key = cache_key( Inst, EffectiveFeatures() );
+    cachedResult res;
+    bool found;
+#pragma omp critical(timbl_cache)
+    found = result_cache->lookup( key, res );
+    if ( found ){
+      if ( !bestResult.reset( beamSize, normalisation, norm_factor, Targets ) ){
+	Warning( "no normalisation possible because a BeamSize is specified\n"
+		 "output is NOT normalized!" );
+      }
+      if ( res.top ){
+	bestResult.addTop( res.top );
+      }
+      else if ( res.dist ){
+	bestResult.addDisposable( res.dist );
+      }
+      Distance = res.distance;
+      exact = res.exact;
+      if ( res.has_depth ){
+	match_depth = res.match_depth;
+	last_leaf = res.last_leaf;
+      }
+      if ( res.counted_exact )
+	stats.addExact();
+      if ( confusionInfo ){
+	confusionInfo->Increment( Inst.TV, res.target );
+      }
+      bool correct = Inst.TV && ( res.target == Inst.TV );
+      if ( correct ){
+	stats.addCorrect();
+	if ( res.tie )
+	  stats.addTieCorrect();
+      }
+      else if ( res.tie )
+	stats.addTieFailure();
+      return res.target;
+    }
+    unsigned int exacts = stats.exactMatches();
+    unsigned int ties = stats.tiedCorrect() + stats.tiedFailure();
+    // not every path of LocalClassify sets the match depth
+    size_t old_depth = match_depth;
+    bool old_leaf = last_leaf;
+    match_depth = string::npos;
+    res.target = LocalClassify( Inst, Distance, exact );
+    if ( match_depth == string::npos ){
+      match_depth = old_depth;
+      last_leaf = old_leaf;
+    }
+    else {
+      res.has_depth = true;
+    }
+    if ( res.target ){
+      res.distance = Distance;
+      res.exact = exact;
+      res.counted_exact = stats.exactMatches() > exacts;
+      res.tie = stats.tiedCorrect() + stats.tiedFailure() > ties;
+      res.match_depth = match_depth;
+      res.last_leaf = last_leaf;
+      const ValueDistribution *vd = bestResult.rawDistribution();
+      if ( vd ){
+	if ( bestResult.topResult() )
+	  res.top = vd;
+	else
+	  res.dist = vd->to_WVD_Copy();
+      }
+#pragma omp critical(timbl_cache)
+      result_cache->store( key, res );
+    }
+    return res.target;
+  }
+
   const TargetValue *TimblExperiment::classifyString( const string& Line,
 						      double& Distance ){
     Distance = -1.0;
@@ -1599,7 +2090,41 @@ namespace Timbl {
 	 chopLine( Line ) ){
       chopped_to_instance( TestWords );
       bool exact = false;
-      BestT = LocalClassify( CurrInst, Distance, exact );
+      BestT = cachedClassify( CurrInst, Distance, exact );
+    }
+    return BestT;
+  }
+
+  size_t TimblExperiment::encodeFeatureValue( size_t feature,
+					      const string& value ) const {
+    // the id of a value of a feature, for classifyValues()
+    // 0 for values not seen in training
+    if ( feature >= NumOfFeatures() )
+      return 0;
+    const FeatureValue *fv = Features[feature]->Lookup( value );
+    return fv ? fv->Index() : 0;
+  }
+
+  const TargetValue *TimblExperiment::classifyFields( const vector<string>& fields,
+						      double& Distance ){
+    Distance = -1.0;
+    const TargetValue *BestT = NULL;
+    if ( checkFields( fields.size() ) ){
+      fields_to_instance( fields );
+      bool exact = false;
+      BestT = cachedClassify( CurrInst, Distance, exact );
+    }
+    return BestT;
+  }
+
+  const TargetValue *TimblExperiment::classifyValues( const vector<size_t>& ids,
+						      double& Distance ){
+    Distance = -1.0;
+    const TargetValue *BestT = NULL;
+    if ( checkFields( ids.size() ) ){
+      values_to_instance( ids );
+      bool exact = false;
+      BestT = cachedClassify( CurrInst, Distance, exact );
     }
     return BestT;
   }
@@ -1630,6 +2155,16 @@ namespace Timbl {
     return result;
   }
 
+  void TimblExperiment::show_search_info( ostream& os ) const {
+    const IB_columns *cols = InstanceBase?InstanceBase->Columns():0;
+    if ( cols ){
+      os << "Search        : linear scan of " << cols->leafCount()
+	 << " instances, the paths in the tree separate after "
+	 << InstanceBase->SpreadLevel() << " of " << EffectiveFeatures()
+	 << " levels" << endl;
+    }
+  }
+
   void TimblExperiment::show_metric_info( ostream& os ) const {
     os << "Global metric : " << TiCC::toString( globalMetricOption, true);
     if ( GlobalMetric->isStorable() ){
@@ -1712,16 +2247,19 @@ namespace Timbl {
       show_metric_info( os );
       show_weight_info( os );
       os << decay << endl;
+      show_search_info( os );
     }
   }
 
   class threadData {
   public:
-    threadData():exp(0), lineNo(0), resultTarget(0),
+    threadData():exp(0), cache(0), row(0), lineNo(0), resultTarget(0),
 		 exact(false), distance(-1), confidence(0) {};
     bool exec();
     void show( ostream& ) const;
     TimblExperiment *exp;
+    const DataCache *cache;
+    size_t row;
     string Buffer;
     unsigned int lineNo;
     const TargetValue *resultTarget;
@@ -1735,29 +2273,30 @@ namespace Timbl {
     resultTarget = 0;
 // #pragma omp critical
 //     cerr << "exec " << lineNo << " '" << Buffer << "'" << endl;
-    if ( Buffer.empty() ){
+    if ( cache ){
+      exp->chopRow( cache, row );
+    }
+    else if ( Buffer.empty() ){
       return false;
     }
-    if ( !exp->chopLine( Buffer ) ){
+    else if ( !exp->chopLine( Buffer ) ){
       exp->Warning( "testfile, skipped line #" +
 		    TiCC::toString<int>( lineNo ) +
 		    "\n" + Buffer );
       return false;
     }
-    else {
-      exp->chopped_to_instance( TimblExperiment::TestWords );
-      exact = false;
-      resultTarget = exp->LocalClassify( exp->CurrInst,
-					 distance,
-					 exact );
-      exp->normalizeResult();
-      distrib = exp->bestResult.getResult();
-      if ( exp->Verbosity(CONFIDENCE) )
-	confidence = exp->bestResult.confidence(resultTarget);
-      else
-	confidence = 0;
-      return true;
-    }
+    exp->chopped_to_instance( TimblExperiment::TestWords );
+    exact = false;
+    resultTarget = exp->cachedClassify( exp->CurrInst,
+					distance,
+					exact );
+    exp->normalizeResult();
+    distrib = exp->bestResult.getResult();
+    if ( exp->Verbosity(CONFIDENCE) )
+      confidence = exp->bestResult.confidence(resultTarget);
+    else
+      confidence = 0;
+    return true;
   }
 
   void threadData::show( ostream& os ) const {
@@ -1800,6 +2339,7 @@ namespace Timbl {
       exps[i].Buffer = "";
       int cnt;
       bool goon = exps[0].exp->nextLine( is, exps[i].Buffer, cnt );
+      exps[i].cache = exps[0].exp->takeRow( exps[i].row );
       exps[i].lineNo += cnt;
       if ( !goon && i == 0 )
 	result = false;
@@ -1810,6 +2350,7 @@ namespace Timbl {
   void threadBlock::finalize(){
     for ( size_t i=1; i < size; ++i ){
       exps[0].exp->stats.merge( exps[i].exp->stats );
+      exps[0].exp->InstanceBase->addVisits( exps[i].exp->InstanceBase->NodeVisits() );
       if ( exps[0].exp->confusionInfo ){
 	exps[0].exp->confusionInfo->merge( exps[i].exp->confusionInfo );
       }
@@ -1823,7 +2364,12 @@ namespace Timbl {
     bool result = false;
     if ( initTestFiles( FileName, OutFile ) ){
       initExperiment();
+      cacheScope use_cache( this, testStreamName, testStream );
       stats.clear();
+      if ( result_cache )
+	result_cache->resetCounts();
+      if ( InstanceBase )
+	InstanceBase->resetVisits();
       showTestingInfo( *mylog );
       if ( numOfThreads > 1 ){
 	omp_set_num_threads( numOfThreads );
@@ -1880,7 +2426,12 @@ namespace Timbl {
     bool result = false;
     if ( initTestFiles( FileName, OutFile ) ){
       initExperiment();
+      cacheScope use_cache( this, testStreamName, testStream );
       stats.clear();
+      if ( result_cache )
+	result_cache->resetCounts();
+      if ( InstanceBase )
+	InstanceBase->resetVisits();
       showTestingInfo( *mylog );
       // Start time.
       //
@@ -1903,9 +2454,9 @@ namespace Timbl {
 	  string distrib;
 	  double distance;
 	  double confidence = 0;
-	  const TargetValue *resultTarget = LocalClassify( CurrInst,
-							   distance,
-							   exact );
+	  const TargetValue *resultTarget = cachedClassify( CurrInst,
+							    distance,
+							    exact );
 	  normalizeResult();
 	  distrib = bestResult.getResult();
 	  if ( Verbosity(CONFIDENCE) )
@@ -1943,7 +2494,12 @@ namespace Timbl {
     bool result = false;
     if ( initTestFiles( FileName, OutFile ) ){
       initExperiment();
+      cacheScope use_cache( this, testStreamName, testStream );
       stats.clear();
+      if ( result_cache )
+	result_cache->resetCounts();
+      if ( InstanceBase )
+	InstanceBase->resetVisits();
       showTestingInfo( *mylog );
       // Start time.
       //
@@ -1978,6 +2534,229 @@ namespace Timbl {
     return result;
   }
 
+  void TimblExperiment::setSweep( const vector<size_t>& ks,
+				  const vector<decayStruct *>& decays,
+				  bool files ){
+    // takes ownership of the decays
+    for ( const auto& d : sweep_decays ){
+      delete d;
+    }
+    sweep_k = ks;
+    sweep_decays = decays;
+    sweep_files = files;
+  }
+
+  class sweepSetting {
+  public:
+    sweepSetting( size_t kk, const decayStruct *d ):
+      k(kk), decay(d), extra_slot(false), confusion(0), out(0) {};
+    ~sweepSetting(){ delete confusion; delete out; };
+    string name() const;
+    WValueDistribution *distribution( const neighborSet&, size_t ) const;
+    size_t k;
+    const decayStruct *decay;
+    bool extra_slot;
+    StatisticsClass stats;
+    ConfusionMatrix *confusion;
+    ofstream *out;
+  private:
+    sweepSetting( const sweepSetting& );
+    sweepSetting& operator=( const sweepSetting& );
+  };
+
+  string sweepSetting::name() const {
+    string result = "k" + TiCC::toString( k ) + "." + TiCC::toString( decay->type() );
+    if ( decay->type() == ExpDecay ){
+      result += TiCC::toString( decay->alpha ) + "_"
+	+ TiCC::toString( decay->beta );
+    }
+    return result;
+  }
+
+  WValueDistribution *sweepSetting::distribution( const neighborSet& all,
+						  size_t len ) const {
+    // the distribution a separate run with this setting gets from its
+    // first len neighbors. Once such a run has resolved a tie with an
+    // extra neighbor, its BestArray keeps that slot, and it ends up in
+    // the neighbor set as an empty neighbor at distance DBL_MAX. With
+    // Inverse Linear decay every neighbor then gets a weight of 1
+    neighborSet ns( all );
+    ns.truncate( len );
+    if ( extra_slot && len == k && decay->type() == InvLinear ){
+      return ns.bestDistribution();
+    }
+    return ns.bestDistribution( decay );
+  }
+
+  bool TimblExperiment::SweepTest( const string& FileName,
+				   const string& OutFile ){
+    // classify the testfile for all combinations of the requested k's
+    // and decays, using one search with the largest k per instance.
+    // The outputfile gets the results for the largest k and the first
+    // decay, the other settings only get their own file with sweep_files
+    bool result = false;
+    if ( sweep_k.empty() || sweep_decays.empty() ){
+      Error( "SweepTest called without a sweep" );
+      return false;
+    }
+    if ( initTestFiles( FileName, OutFile ) ){
+      initExperiment();
+      cacheScope use_cache( this, testStreamName, testStream );
+      stats.clear();
+      if ( InstanceBase )
+	InstanceBase->resetVisits();
+      showTestingInfo( *mylog );
+      size_t max_k = 0;
+      for ( const auto& k : sweep_k ){
+	max_k = max( max_k, k );
+      }
+      vector<sweepSetting *> settings;
+      sweepSetting *primary = 0;
+      for ( const auto& k : sweep_k ){
+	for ( const auto& d : sweep_decays ){
+	  sweepSetting *s = new sweepSetting( k, d );
+	  if ( Verbosity(ADVANCED_STATS) ){
+	    s->confusion = new ConfusionMatrix( Targets->ValuesArray.size() );
+	  }
+	  if ( !primary && k == max_k ){
+	    primary = s;
+	  }
+	  else if ( sweep_files ){
+	    s->out = new ofstream( OutFile + "." + s->name() );
+	  }
+	  settings.push_back( s );
+	}
+      }
+      time_t lStartTime;
+      time(&lStartTime);
+      timeval startTime;
+      gettimeofday( &startTime, 0 );
+      if ( InputFormat() == ARFF )
+	skipARFFHeader( testStream );
+      string Buffer;
+      bool use_exact = !GlobalMetric->isSimilarityMetric();
+      while ( nextLine( testStream, Buffer ) ){
+	if ( !chopLine( Buffer ) ) {
+	  Warning( "testfile, skipped line #" +
+		   TiCC::toString<int>( stats.totalLines() ) +
+		   "\n" + Buffer );
+	  continue;
+	}
+	chopped_to_instance( TestWords );
+	const ValueDistribution *ExResultDist = 0;
+	if ( use_exact ){
+	  ExResultDist = InstanceBase->ExactMatch( CurrInst );
+	}
+	// one extra neighbor, to resolve ties for the largest k
+	size_t keep_k = num_of_neighbors;
+	num_of_neighbors = max_k + 1;
+	nSet.clear();
+	testInstance( CurrInst, InstanceBase );
+	bestArray.initNeighborSet( nSet );
+	num_of_neighbors = keep_k;
+	for ( const auto& s : settings ){
+	  // the same steps as LocalClassify(), with the first k neighbors
+	  bool Tie = false;
+	  double Distance;
+	  const TargetValue *Res;
+	  WValueDistribution *ResultDist = 0;
+	  bool recurse = true;
+	  if ( ExResultDist && ( s->k == 1 || Do_Exact() ) ){
+	    Distance = 0.0;
+	    recurse = !Do_Exact();
+	    Res = ExResultDist->BestTarget( Tie, (RandomSeed() >= 0) );
+	  }
+	  else {
+	    ResultDist = s->distribution( nSet, s->k );
+	    Res = ResultDist->BestTarget( Tie, (RandomSeed() >= 0) );
+	    Distance = nSet.bestDistance();
+	  }
+	  if ( Tie && recurse ){
+	    bool Tie2 = true;
+	    WValueDistribution *ResultDist2 = s->distribution( nSet, s->k+1 );
+	    s->extra_slot = true;
+	    const TargetValue *Res2 = ResultDist2->BestTarget( Tie2, (RandomSeed() >= 0) );
+	    if ( !Tie2 ){
+	      Res = Res2;
+	      delete ResultDist;
+	      ResultDist = ResultDist2;
+	    }
+	    else {
+	      delete ResultDist2;
+	    }
+	  }
+	  bool exact = fabs(Distance) < Epsilon;
+	  if ( !ResultDist ){
+	    exact = exact || Do_Exact();
+	  }
+	  s->stats.addLine();
+	  if ( exact )
+	    s->stats.addExact();
+	  if ( s->confusion ){
+	    s->confusion->Increment( CurrInst.TV, Res );
+	  }
+	  if ( CurrInst.TV && ( Res == CurrInst.TV ) ){
+	    s->stats.addCorrect();
+	    if ( Tie )
+	      s->stats.addTieCorrect();
+	  }
+	  else if ( Tie )
+	    s->stats.addTieFailure();
+	  ostream *os = ( s == primary )?&outStream:s->out;
+	  if ( os ){
+	    bestResult.reset( beamSize, normalisation, norm_factor, Targets );
+	    if ( ResultDist )
+	      bestResult.addDisposable( ResultDist );
+	    else
+	      bestResult.addConstant( ExResultDist );
+	    normalizeResult();
+	    double confidence = 0;
+	    if ( Verbosity(CONFIDENCE) )
+	      confidence = bestResult.confidence( Res );
+	    show_results( *os, confidence, bestResult.getResult(),
+			  Res, Distance );
+	  }
+	  else {
+	    delete ResultDist;
+	  }
+	}
+	if ( !Verbosity(SILENT) )
+	  // Display progress counter.
+	  show_progress( *mylog, lStartTime, primary->stats.dataLines() );
+      }
+      // the overall statistics are those of the primary setting
+      stats = primary->stats;
+      if ( !Verbosity(SILENT) ){
+	time_stamp( "Ready:  ", stats.dataLines() );
+	show_speed_summary( *mylog, startTime );
+      }
+      if ( !Verbosity(SILENT) ){
+	for ( const auto& s : settings ){
+	  *mylog << endl << "Setting " << s->name();
+	  if ( s == primary ){
+	    *mylog << " (" << outStreamName << ")";
+	  }
+	  else if ( s->out ){
+	    *mylog << " (" << OutFile << "." << s->name() << ")";
+	  }
+	  *mylog << ":";
+	  show_statistics( *mylog, s->stats, s->confusion );
+	}
+	*mylog << endl << "Sweep summary:" << endl;
+	for ( const auto& s : settings ){
+	  *mylog << setw(20) << left << s->name() << right << " "
+		 << s->stats.testedCorrect()/(double)s->stats.dataLines()
+		 << endl;
+	}
+      }
+      for ( const auto& s : settings ){
+	delete s;
+      }
+      result = true;
+    }
+    return result;
+  }
+
   bool TimblExperiment::SetOptions( int argc, const char **argv ){
     if ( IsClone() ){
       TiCC::CL_Options Opts( timbl_serv_short_opts, "" );
@@ -2186,6 +2965,7 @@ namespace Timbl {
 	  Info( "Reading weights from " + FileName );
 	if ( readWeights( weightsfile, w ) ){
 	  WFileName = FileName;
+	  clearCache();
 	  return true;
 	}
 	else {
@@ -2296,6 +3076,7 @@ namespace Timbl {
 	InstanceBase = new IB_InstanceBase( EffectiveFeatures(),
 					    ibCount,
 					    (RandomSeed()>=0) );
+	InstanceBase->ReadThreads( Clones() );
 	if ( Hashed )
 	  result = InstanceBase->ReadIB( is, PermFeatures,
 					 Targets,
@@ -2352,6 +3133,10 @@ namespace Timbl {
   void IB1_Experiment::InitInstanceBase(){
     srand( RandomSeed() );
     set_order();
+    if ( TreeOrder == SearchOrder ){
+      searchTreeOrder();
+      srand( RandomSeed() );
+    }
     runningPhase = TrainWords;
     InstanceBase = new IB_InstanceBase( EffectiveFeatures(),
 					ibCount,
@@ -2379,10 +3164,11 @@ namespace Timbl {
     size_t cur_pos = 0;
     // Open the file.
     //
-    ifstream datafile( file_name, ios::in);
+    DataStream datafile( file_name, ios::in);
+    cacheScope use_cache( this, file_name, datafile, true );
     if ( InputFormat() == ARFF )
       skipARFFHeader( datafile );
-    cur_pos = datafile.tellg();
+    cur_pos = linePos( datafile );
     if ( !nextLine( datafile, Buffer ) ){
       Error( "cannot start learning from in: " + file_name );
       result = false;    // No more input
@@ -2416,7 +3202,7 @@ namespace Timbl {
 	  time_stamp( "Indexing:  ", stats.dataLines() );
 	bool found = false;
 	while ( !found &&
-		( cur_pos = datafile.tellg(),
+		( cur_pos = linePos( datafile ),
 		  nextLine( datafile, Buffer ) ) ){
 	  found = chopLine( Buffer );
 	  if ( !found ){
@@ -2440,10 +3226,11 @@ namespace Timbl {
     size_t cur_pos = 0;
     // Open the file.
     //
-    ifstream datafile( file_name, ios::in);
+    DataStream datafile( file_name, ios::in);
+    cacheScope use_cache( this, file_name, datafile, true );
     if ( InputFormat() == ARFF )
       skipARFFHeader( datafile );
-    cur_pos = datafile.tellg();
+    cur_pos = linePos( datafile );
     if ( !nextLine( datafile, Buffer ) ){
       Error( "cannot start learning from in: " + file_name );
       result = false;    // No more input
@@ -2478,7 +3265,7 @@ namespace Timbl {
 	}
 	bool found = false;
 	while ( !found &&
-		( cur_pos = datafile.tellg(),
+		( cur_pos = linePos( datafile ),
 		  nextLine( datafile, Buffer ) ) ){
 	  found = chopLine( Buffer );
 	  if ( !found ){
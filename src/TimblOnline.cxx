@@ -0,0 +1,262 @@
+/*
+  Copyright (c) 1998 - 2017
+  ILK   - Tilburg University
+  CLST  - Radboud University
+  CLiPS - University of Antwerp
+
+  This file is part of timbl
+
+  timbl is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  timbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/timbl/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+*/
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include "timbl/Common.h"
+#include "timbl/MsgClass.h"
+#include "timbl/Types.h"
+#include "timbl/Options.h"
+#include "timbl/Instance.h"
+#include "timbl/neighborSet.h"
+#include "timbl/BestArray.h"
+#include "timbl/Statistics.h"
+#include "timbl/MBLClass.h"
+#include "ticcutils/CommandLine.h"
+#include "timbl/GetOptClass.h"
+
+using namespace std;
+
+#include "timbl/TimblAPI.h"
+#include "timbl/TimblExperiment.h"
+
+namespace Timbl {
+
+  //
+  // The two copies are used 'left-right': readers only use the active
+  // copy, and register on it before they start. The writer updates the
+  // other copy, waits for readers that slipped onto it before the last
+  // switch, switches, and then waits for the readers on the old copy
+  // to finish before updating that one too.
+  //
+  TimblOnline::TimblOnline( const string& opts, const string& name ):
+    active( 0 ),
+    version( 0 ),
+    batch_size( 1 )
+  {
+    for ( int i=0; i < 2; ++i ){
+      sides[i] = new TimblAPI( opts, name );
+      readers[i] = 0;
+      stamps[i] = 0;
+    }
+  }
+
+  TimblOnline::~TimblOnline(){
+    waitForReaders( 0 );
+    waitForReaders( 1 );
+    delete sides[0];
+    delete sides[1];
+  }
+
+  bool TimblOnline::Valid() const {
+    return sides[0]->Valid() && sides[1]->Valid();
+  }
+
+  bool TimblOnline::Learn( const string& file ){
+    if ( !Valid() ){
+      return false;
+    }
+    if ( sides[0]->Algo() != IB1 ){
+      cerr << "online learning is only possible for IB1" << endl;
+      return false;
+    }
+    lock_guard<mutex> lock( publish_lock );
+    // readers are only allowed after this
+    for ( int i=0; i < 2; ++i ){
+      if ( !sides[i]->Learn( file ) ){
+	return false;
+      }
+      sides[i]->pimpl->initExperiment();
+    }
+    return true;
+  }
+
+  bool TimblOnline::enqueue( bool add, const string& line ){
+    if ( !Valid() ){
+      return false;
+    }
+    size_t waiting;
+    {
+      lock_guard<mutex> lock( queue_lock );
+      pending.push_back( make_pair( add, line ) );
+      waiting = pending.size();
+    }
+    if ( waiting >= batch_size ){
+      Publish();
+    }
+    return true;
+  }
+
+  bool TimblOnline::Increment( const string& line ){
+    return enqueue( true, line );
+  }
+
+  bool TimblOnline::Decrement( const string& line ){
+    return enqueue( false, line );
+  }
+
+  size_t TimblOnline::Pending() const {
+    lock_guard<mutex> lock( queue_lock );
+    return pending.size();
+  }
+
+  void TimblOnline::waitForReaders( int side ) const {
+    while ( readers[side] > 0 ){
+      this_thread::yield();
+    }
+  }
+
+  bool TimblOnline::apply( int side,
+			   const vector<pair<bool,string>>& batch ){
+    bool result = true;
+    TimblAPI *exp = sides[side];
+    for ( const auto& it : batch ){
+      if ( it.first ){
+	result = exp->Increment( it.second ) && result;
+      }
+      else {
+	result = exp->Decrement( it.second ) && result;
+      }
+    }
+    exp->pimpl->initExperiment();
+    return result;
+  }
+
+  size_t TimblOnline::Publish(){
+    // applies the pending changes, and returns the new version
+    lock_guard<mutex> lock( publish_lock );
+    vector<pair<bool,string>> batch;
+    {
+      lock_guard<mutex> q_lock( queue_lock );
+      batch.swap( pending );
+    }
+    if ( batch.empty() ){
+      return version;
+    }
+    int standby = 1 - active;
+    waitForReaders( standby );
+    bool ok = apply( standby, batch );
+    stamps[standby] = version + 1;
+    active = standby;
+    ++version;
+    waitForReaders( 1 - standby );
+    apply( 1 - standby, batch );
+    stamps[1 - standby] = (size_t)version;
+    if ( !ok ){
+      cerr << "some of the changes in version " << version
+	   << " could not be applied" << endl;
+    }
+    return version;
+  }
+
+  TimblExperiment *TimblOnline::snapshot( int side ) const {
+    if ( sides[side]->Valid() ){
+      return sides[side]->pimpl->snapshotChild();
+    }
+    return 0;
+  }
+
+  TimblReader::TimblReader( TimblOnline& online ):
+    model( online ),
+    version( 0 )
+  {
+    for ( int i=0; i < 2; ++i ){
+      children[i] = 0;
+      stamps[i] = 0;
+    }
+  }
+
+  TimblReader::~TimblReader(){
+    delete children[0];
+    delete children[1];
+  }
+
+  TimblExperiment *TimblReader::enter( int& side ){
+    // register on the active copy, and make sure it still is active
+    // afterwards, so the writer won't touch it while we are busy
+    while ( true ){
+      side = model.active;
+      ++model.readers[side];
+      if ( model.active == side ){
+	break;
+      }
+      --model.readers[side];
+    }
+    version = model.stamps[side];
+    if ( !children[side] || stamps[side] != version ){
+      delete children[side];
+      children[side] = 0;
+      children[side] = model.snapshot( side );
+      stamps[side] = version;
+    }
+    if ( !children[side] ){
+      leave( side );
+    }
+    return children[side];
+  }
+
+  void TimblReader::leave( int side ){
+    --model.readers[side];
+  }
+
+  bool TimblReader::Classify( const string& line, string& result ){
+    int side;
+    TimblExperiment *exp = enter( side );
+    if ( !exp ){
+      return false;
+    }
+    bool ok = exp->Classify( line, result );
+    leave( side );
+    return ok;
+  }
+
+  bool TimblReader::Classify( const string& line, string& result,
+			      double& distance ){
+    int side;
+    TimblExperiment *exp = enter( side );
+    if ( !exp ){
+      return false;
+    }
+    bool ok = exp->Classify( line, result, distance );
+    leave( side );
+    return ok;
+  }
+
+  bool TimblReader::Classify( const string& line, string& result,
+			      string& dist, double& distance ){
+    int side;
+    TimblExperiment *exp = enter( side );
+    if ( !exp ){
+      return false;
+    }
+    bool ok = exp->Classify( line, result, dist, distance );
+    leave( side );
+    return ok;
+  }
+
+}
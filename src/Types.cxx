@@ -97,7 +97,8 @@ namespace Timbl {
 				     { "SDO", "Standard Deviation" },
 				     { "X/V", "Chi-Squared/Values" },
 				     { "S/V", "Shared Variance/Values" },
-				     { "SD/V", "Standard Deviation/Values" } };
+				     { "SD/V", "Standard Deviation/Values" },
+				     { "SCO", "Search Cost" } };
 
   const string InputFormatName[][2] = {
     { "Unknown", "Unknown Input Format" },
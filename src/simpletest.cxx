@@ -27,17 +27,124 @@
 
 #include "timbl/TimblAPI.h"
 #include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+using namespace std;
+
+static bool slurp( const string& name, string& contents ){
+  ifstream is( name );
+  if ( !is )
+    return false;
+  contents.assign( istreambuf_iterator<char>( is ),
+		   istreambuf_iterator<char>() );
+  return true;
+}
+
+static bool string_clone_test(){
+  // the string metrics cache distances and value signatures while they
+  // work. Every clone needs its own copy of them, so testing with
+  // threads must give the output of a single thread.
+  srand( 4711 );
+  const pair<string,size_t> files[] = { { "strings.train", 3000 },
+					 { "strings.test", 500 } };
+  for ( const auto& file : files ){
+    ofstream os( file.first );
+    for ( size_t i=0; i < file.second; ++i ){
+      size_t len = 0;
+      for ( int f=0; f < 3; ++f ){
+	int l = 4 + rand() % 5;
+	len += l;
+	for ( int c=0; c < l; ++c ){
+	  os << (char)( 'a' + rand() % 10 );
+	}
+	os << ",";
+      }
+      os << ( len % 2 ? "X" : "Y" ) << endl;
+    }
+  }
+  for ( const auto& metric : { "-mDC", "-mL" } ){
+    string out[2];
+    for ( int clones=1; clones <= 8; clones += 7 ){
+      string opts = string( metric ) + " -k3 --clones="
+	+ to_string( clones );
+      Timbl::TimblAPI exp( opts, "strings" );
+      if ( !exp.isValid()
+	   || !exp.Learn( "strings.train" )
+	   || !exp.Test( "strings.test", "strings.out" )
+	   || !slurp( "strings.out", out[clones > 1] ) ){
+	return false;
+      }
+    }
+    if ( out[0].empty() || out[0] != out[1] ){
+      cerr << "strings: " << metric << " differs with clones" << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool bounds_test(){
+  // the least distances used by --bounds may only be remembered for
+  // values seen in training. The unseen values of a test instance are
+  // recycled for the next one, where they stand for another string.
+  // Here the unseen values alternate between one with a close neighbor
+  // in training and one without, so a remembered distance prunes the
+  // true nearest neighbors.
+  srand( 1234 );
+  {
+    ofstream os( "bounds.train" );
+    for ( int i=0; i < 2000; ++i ){
+      int n;
+      do {
+	n = 1 + rand() % 1000;
+      } while ( n == 400 || ( n >= 90 && n <= 110 ) );
+      int o = rand() % 3;
+      os << "w" << ( rand() % 40 ) << "xyz," << "opq"[o] << ","
+	 << n << "," << ( o == 0 ? 'X' : "XY"[rand() % 2] ) << endl;
+    }
+  }
+  {
+    ofstream os( "bounds.test" );
+    for ( int i=0; i < 600; ++i ){
+      os << ( i % 2 ? "w7xyq" : "abcdefgh" ) << ",r,"
+	 << ( i % 2 ? 400 : 101 ) << "," << "XY"[rand() % 2] << endl;
+    }
+  }
+  for ( const auto& metric : { "-mO:N3", "-mL:O2" } ){
+    string out[2];
+    for ( int b=0; b < 2; ++b ){
+      string opts = string( metric ) + " -k1 +vdb"
+	+ ( b ? " --bounds=1" : "" );
+      Timbl::TimblAPI exp( opts, "bounds" );
+      if ( !exp.isValid()
+	   || !exp.Learn( "bounds.train" )
+	   || !exp.Test( "bounds.test", "bounds.out" )
+	   || !slurp( "bounds.out", out[b] ) ){
+	return false;
+      }
+    }
+    if ( out[0].empty() || out[0] != out[1] ){
+      cerr << "bounds: " << metric << " differs with --bounds" << endl;
+      return false;
+    }
+  }
+  return true;
+}
 
 int main(){
-  std::string path = std::getenv( "topsrcdir" );
-  std::cerr << path << std::endl;
+  string path = getenv( "topsrcdir" );
+  cerr << path << endl;
 
   Timbl::TimblAPI exp( "+vdi+db", "test1" );
   if ( exp.isValid() ){
     exp.Learn( path + "/demos/dimin.train" );
     if ( exp.isValid() ){
       exp.Test( path + "/demos/dimin.test", "dimin.out" );
-      if ( exp.isValid() )
+      if ( exp.isValid()
+	   && string_clone_test()
+	   && bounds_test() )
 	return EXIT_SUCCESS;
     }
   }